@@ -5,6 +5,7 @@
 
 #include <WiFi.h>
 #include <WiFiManager.h>
+#include <esp_wifi.h>
 
 namespace agent {
 
@@ -12,6 +13,10 @@ namespace {
 
 constexpr uint8_t kSetupButtonPin = 0;
 constexpr unsigned long kSetupButtonHoldMs = 5000;
+// Directed connect to the remembered AP skips the full channel scan; if the
+// AP moved or changed channel we fall back to WiFiManager well before its
+// own 20 s connect timeout.
+constexpr unsigned long kWifiFastConnectTimeoutMs = 3000;
 unsigned long gSetupButtonPressStartMs = 0;
 bool gSetupResetTriggered = false;
 
@@ -19,6 +24,83 @@ bool isSetupButtonPressed() {
   return digitalRead(kSetupButtonPin) == LOW;
 }
 
+// Applies the optional static IP from RuntimeConfig. With DHCP the lease
+// negotiation alone often costs more than the association; a static lease
+// removes it entirely. Malformed values are logged and ignored (DHCP wins).
+void applyStaticIpConfig() {
+  if (gRuntimeConfig.staticIp.isEmpty() || gRuntimeConfig.staticGateway.isEmpty()
+      || gRuntimeConfig.staticNetmask.isEmpty()) {
+    return;
+  }
+  IPAddress ip, gateway, netmask, dns;
+  if (!ip.fromString(gRuntimeConfig.staticIp) || !gateway.fromString(gRuntimeConfig.staticGateway)
+      || !netmask.fromString(gRuntimeConfig.staticNetmask)) {
+    logWarn("transport", "Invalid static IP config; falling back to DHCP", "static_ip_invalid");
+    return;
+  }
+  if (gRuntimeConfig.staticDns.isEmpty() || !dns.fromString(gRuntimeConfig.staticDns)) {
+    dns = gateway;
+  }
+  WiFi.config(ip, gateway, netmask, dns);
+}
+
+// Remembers the AP we just associated with so the next boot can attempt a
+// directed connect (exact BSSID + channel) instead of a full scan.
+void persistWifiFastConnectInfo() {
+  const uint8_t* bssid = WiFi.BSSID();
+  const int32_t channel = WiFi.channel();
+  if (bssid == nullptr || channel <= 0) {
+    return;
+  }
+  gPrefs.begin(kPrefsNamespace, false);
+  gPrefs.putBytes("wifi_bssid", bssid, 6);
+  gPrefs.putInt("wifi_chan", channel);
+  gPrefs.end();
+}
+
+void clearWifiFastConnectInfo() {
+  gPrefs.begin(kPrefsNamespace, false);
+  gPrefs.remove("wifi_bssid");
+  gPrefs.remove("wifi_chan");
+  gPrefs.end();
+}
+
+// Attempts the fast path: stored credentials plus persisted BSSID/channel.
+// Returns true once associated; on timeout the radio is left disconnected
+// and the regular WiFiManager flow takes over.
+bool tryWifiFastConnect() {
+  uint8_t bssid[6];
+  gPrefs.begin(kPrefsNamespace, true);
+  const size_t bssidLen = gPrefs.getBytes("wifi_bssid", bssid, sizeof(bssid));
+  const int32_t channel = gPrefs.getInt("wifi_chan", 0);
+  gPrefs.end();
+  if (bssidLen != sizeof(bssid) || channel <= 0 || channel > 14) {
+    return false;
+  }
+
+  // Credentials live in the Wi-Fi driver's own NVS blob (written by the last
+  // successful WiFiManager run) — read them back instead of duplicating them.
+  wifi_config_t wifiConfig;
+  if (esp_wifi_get_config(WIFI_IF_STA, &wifiConfig) != ESP_OK || wifiConfig.sta.ssid[0] == '\0') {
+    return false;
+  }
+
+  applyStaticIpConfig();
+  WiFi.begin(reinterpret_cast<const char*>(wifiConfig.sta.ssid),
+             reinterpret_cast<const char*>(wifiConfig.sta.password), channel, bssid, true);
+
+  const unsigned long deadline = millis() + kWifiFastConnectTimeoutMs;
+  while (millis() < deadline) {
+    if (WiFi.status() == WL_CONNECTED) {
+      return true;
+    }
+    delay(20);
+  }
+
+  WiFi.disconnect();
+  return false;
+}
+
 void clearNetworkProvisioningState() {
   WiFiManager wm;
   wm.resetSettings();
@@ -31,6 +113,7 @@ void clearNetworkProvisioningState() {
 
   gMqttClient.disconnect();
   WiFi.disconnect(true, true);
+  clearWifiFastConnectInfo();
   logWarn("system", "Wi-Fi and MQTT provisioning reset triggered", "provisioning_reset");
 }
 
@@ -61,6 +144,16 @@ void configureWifiAndRuntime() {
   WiFi.setSleep(WIFI_PS_NONE);
 
   const bool forceConfigPortal = shouldForceConfigPortal();
+
+  // Fast path: directed connect to the remembered AP. MQTT settings are
+  // already loaded from NVS, so a successful association is all boot needs —
+  // skipping WiFiManager keeps boot-to-online in the low seconds.
+  if (!forceConfigPortal && tryWifiFastConnect()) {
+    persistWifiFastConnectInfo();
+    logInfo("transport", String("Wi-Fi fast connect ok channel=") + String(WiFi.channel()));
+    return;
+  }
+
   String mqttHost = gRuntimeConfig.mqttHost;
   String mqttPort = String(gRuntimeConfig.mqttPort);
   String mqttUser = gRuntimeConfig.mqttUser;
@@ -71,6 +164,8 @@ void configureWifiAndRuntime() {
   WiFiManagerParameter paramMqttUser("mqtt_user", "MQTT User", mqttUser.c_str(), 64);
   WiFiManagerParameter paramMqttPass("mqtt_pass", "MQTT Password", mqttPass.c_str(), 64);
 
+  applyStaticIpConfig();
+
   WiFiManager wm;
   wm.setConnectTimeout(20);
   wm.setConfigPortalTimeout(240);
@@ -97,6 +192,7 @@ void configureWifiAndRuntime() {
   gRuntimeConfig.mqttPass = String(paramMqttPass.getValue());
   gRuntimeConfig.mqttPass.trim();
   saveRuntimeConfig();
+  persistWifiFastConnectInfo();
 }
 
 void pollWifiConnection() {
@@ -1,15 +1,23 @@
 #include "agent_commands.h"
 
 #include "agent_ir.h"
+#include "agent_ir_worker.h"
+#include "agent_json_arena.h"
 #include "agent_logs.h"
+#include "agent_metrics.h"
+#include "agent_mqtt.h"
 #include "agent_ota.h"
 #include "agent_pairing.h"
 #include "agent_runtime_state.h"
+#include "agent_signal_cache.h"
 #include "agent_state.h"
 
-#include <cmath>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <climits>
+#include <cstring>
 #include <functional>
-#include <mbedtls/base64.h>
 #include <vector>
 
 namespace agent {
@@ -30,11 +38,124 @@ struct PendingOtaRequest {
 
 PendingOtaRequest gPendingOtaRequest;
 
+// Asynchronous learn capture — the command is acknowledged immediately and
+// the decode result (or timeout) is published later on the response topic,
+// so a 30 s capture window never blocks other commands. In burst mode every
+// frame seen inside the window is buffered with its arrival time, so hold
+// repeats are captured in one command instead of N round-trips.
+constexpr size_t kMaxBurstFrames = 16;
+
+struct PendingLearnCapture {
+  bool active = false;
+  bool burst = false;
+  String hubId;
+  String requestId;
+  unsigned long deadlineMs = 0;   // First-frame deadline.
+  unsigned long windowMs = 0;     // Burst window length after the first frame.
+  unsigned long windowEndMs = 0;  // Set when the first frame arrives.
+  uint32_t burstTickUs = 0;       // Shared quantization tick, estimated from
+                                  // the first frame of the window.
+  std::vector<String> frames;
+  std::vector<unsigned long> frameAtMs;
+};
+
+PendingLearnCapture gPendingLearnCapture;
+
+// Bounded command queue — commands are taken off the MQTT callback quickly
+// and executed from processBackgroundTasks(), with a separate lane so control
+// commands never wait behind queued send/capture work.
+constexpr size_t kCommandQueueCapacity = 8;
+constexpr size_t kControlQueueCapacity = 4;
+
+struct QueuedCommand {
+  String command;
+  String payloadJson;
+  unsigned long receivedAtMs = 0;
+  int64_t receivedAtUs = 0;  // esp_timer timestamp for latency metrics
+};
+
+// Arrival timestamp of the command currently being executed, set by
+// processQueuedCommands() for handleCommand's latency bookkeeping.
+int64_t gActiveCommandReceivedUs = 0;
+
+// Jobs handed to the IR worker whose results have not been drained yet; the
+// main loop keeps its sleep short while responses are outstanding.
+size_t gIrJobsInFlight = 0;
+
+QueuedCommand gCommandQueue[kCommandQueueCapacity];
+size_t gCommandQueueHead = 0;
+size_t gCommandQueueCount = 0;
+QueuedCommand gControlQueue[kControlQueueCapacity];
+size_t gControlQueueHead = 0;
+size_t gControlQueueCount = 0;
+
+bool isControlCommand(const String& command) {
+  return command == "learn/stop" || command == "runtime/ota/cancel" ||
+         command == "runtime/reboot";
+}
+
+// Print adapter that passes a byte window of a serialized JSON stream through
+// an incremental base64 encoder into an open MQTT publish session. Used to
+// stream one chunk of an oversized response without ever materialising the
+// full payload (or its base64 form) in memory.
+class Base64WindowPrint : public Print {
+public:
+  Base64WindowPrint(Print &out, size_t windowStart, size_t windowLen)
+      : out_(out), windowStart_(windowStart),
+        windowEnd_(windowStart + windowLen) {}
+
+  size_t write(uint8_t value) override { return write(&value, 1); }
+
+  size_t write(const uint8_t *buffer, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      const size_t pos = position_++;
+      if (pos < windowStart_ || pos >= windowEnd_) {
+        continue;
+      }
+      pending_[pendingLen_++] = buffer[i];
+      if (pendingLen_ == 3) {
+        flushGroup();
+      }
+    }
+    return size;
+  }
+
+  // Emits the final padded base64 group, if any bytes are still pending.
+  void finish() {
+    if (pendingLen_ > 0) {
+      flushGroup();
+    }
+  }
+
+private:
+  void flushGroup() {
+    static const char *kTable =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t group[4];
+    const uint8_t b0 = pending_[0];
+    const uint8_t b1 = (pendingLen_ > 1) ? pending_[1] : 0;
+    const uint8_t b2 = (pendingLen_ > 2) ? pending_[2] : 0;
+    group[0] = kTable[b0 >> 2];
+    group[1] = kTable[((b0 & 0x03) << 4) | (b1 >> 4)];
+    group[2] = (pendingLen_ > 1) ? kTable[((b1 & 0x0F) << 2) | (b2 >> 6)] : '=';
+    group[3] = (pendingLen_ > 2) ? kTable[b2 & 0x3F] : '=';
+    out_.write(group, sizeof(group));
+    pendingLen_ = 0;
+  }
+
+  Print &out_;
+  size_t windowStart_;
+  size_t windowEnd_;
+  size_t position_ = 0;
+  uint8_t pending_[3];
+  uint8_t pendingLen_ = 0;
+};
+
 void sendCommandResponse(const String &hubId, const String &requestId, bool ok,
                          std::function<void(JsonObject)> fillResult,
                          const String &errorCode, const String &errorMessage,
-                         int statusCode) {
-  JsonDocument responseDoc;
+                         int statusCode, unsigned long retryAfterMs = 0) {
+  JsonDocument responseDoc(jsonArena());
   responseDoc["request_id"] = requestId;
   responseDoc["ok"] = ok;
   if (ok) {
@@ -45,63 +166,127 @@ void sendCommandResponse(const String &hubId, const String &requestId, bool ok,
     errorObject["code"] = errorCode;
     errorObject["message"] = errorMessage;
     errorObject["status_code"] = statusCode;
+    if (retryAfterMs > 0) {
+      errorObject["retry_after_ms"] = retryAfterMs;
+    }
   }
   responseDoc["responded_at"] = nowSecondsText();
 
-  String fullJson;
-  fullJson.reserve(512);
-  serializeJson(responseDoc, fullJson);
-
   if (!gMqttClient.connected()) {
     return;
   }
 
   const String responseTopic = topicResponse(hubId, requestId);
+  const size_t fullLen = measureJson(responseDoc);
 
-  if (fullJson.length() <= kMqttChunkSize) {
-    gMqttClient.publish(responseTopic.c_str(), fullJson.c_str(), false);
-    return;
-  }
-
-  // Payload exceeds threshold — base64-encode and send as individual chunk
-  // messages.
-  const size_t inputLen = fullJson.length();
-  const size_t b64MaxLen = ((inputLen + 2) / 3) * 4 + 1;
-  std::vector<unsigned char> b64Buf(b64MaxLen);
-  size_t b64Len = 0;
-  if (mbedtls_base64_encode(
-          b64Buf.data(), b64MaxLen, &b64Len,
-          reinterpret_cast<const unsigned char *>(fullJson.c_str()),
-          inputLen) != 0) {
-    // Encoding failed — publish as-is and let the broker handle it.
-    gMqttClient.publish(responseTopic.c_str(), fullJson.c_str(), false);
+  if (fullLen <= kMqttChunkSize) {
+    // Stream serializeJson output straight into the MQTT socket — no
+    // intermediate payload String.
+    if (!gMqttClient.beginPublish(responseTopic.c_str(), fullLen, false)) {
+      return;
+    }
+    serializeJson(responseDoc, gMqttClient);
+    gMqttClient.endPublish();
     return;
   }
 
+  // Payload exceeds the chunk threshold — stream it as base64 chunk messages.
+  // The raw stride is a multiple of 3 so every chunk except the last encodes
+  // to exactly (stride / 3) * 4 base64 chars with no mid-stream padding, and
+  // concatenating the chunks on the receiver yields one valid base64 stream.
+  // Each chunk re-runs serializeJson over its window; that trades one extra
+  // serialization pass per chunk for never holding the payload in memory.
+  constexpr size_t kChunkRawStride = (kMqttChunkSize / 4) * 3;
   const uint8_t chunkCount =
-      static_cast<uint8_t>((b64Len + kMqttChunkSize - 1) / kMqttChunkSize);
+      static_cast<uint8_t>((fullLen + kChunkRawStride - 1) / kChunkRawStride);
   for (uint8_t i = 0; i < chunkCount; i++) {
-    const size_t chunkStart = static_cast<size_t>(i) * kMqttChunkSize;
-    const size_t chunkLen =
-        std::min<size_t>(kMqttChunkSize, b64Len - chunkStart);
-    const String chunkData(
-        reinterpret_cast<const char *>(b64Buf.data()) + chunkStart, chunkLen);
-
-    JsonDocument chunkDoc;
-    chunkDoc["transfer_id"] = requestId;
-    chunkDoc["chunk_index"] = i;
-    chunkDoc["chunk_count"] = chunkCount;
-    chunkDoc["chunk_data"] = chunkData;
-
-    String chunkPayload;
-    serializeJson(chunkDoc, chunkPayload);
-    gMqttClient.publish(responseTopic.c_str(), chunkPayload.c_str(), false);
+    const size_t rawStart = static_cast<size_t>(i) * kChunkRawStride;
+    const size_t rawLen = std::min<size_t>(kChunkRawStride, fullLen - rawStart);
+    const size_t b64Len = ((rawLen + 2) / 3) * 4;
+
+    String envelopePrefix;
+    envelopePrefix.reserve(128);
+    envelopePrefix += "{\"transfer_id\":\"";
+    envelopePrefix += requestId;
+    envelopePrefix += "\",\"chunk_index\":";
+    envelopePrefix += String(i);
+    envelopePrefix += ",\"chunk_count\":";
+    envelopePrefix += String(chunkCount);
+    envelopePrefix += ",\"chunk_data\":\"";
+    const char *envelopeSuffix = "\"}";
+
+    const size_t payloadLen = envelopePrefix.length() + b64Len + strlen(envelopeSuffix);
+    if (!gMqttClient.beginPublish(responseTopic.c_str(), payloadLen, false)) {
+      return;
+    }
+    gMqttClient.write(reinterpret_cast<const uint8_t *>(envelopePrefix.c_str()),
+                      envelopePrefix.length());
+    Base64WindowPrint windowPrint(gMqttClient, rawStart, rawLen);
+    serializeJson(responseDoc, windowPrint);
+    windowPrint.finish();
+    gMqttClient.write(reinterpret_cast<const uint8_t *>(envelopeSuffix),
+                      strlen(envelopeSuffix));
+    gMqttClient.endPublish();
+  }
+}
+
+// Hands a validated job to the IR worker task. On success the response is
+// deferred — it is published from processBackgroundTasks() once the worker
+// posts the job result.
+// Admission control for expensive commands. When heap or backlog pressure
+// means the work would likely fail mid-flight (ArduinoJson falling back to a
+// starved heap, chunk buffers failing to allocate), rejecting up front with a
+// retry hint beats silent loss or an allocation panic — the hub can pace
+// instead of retry-storming a dying agent.
+constexpr size_t kAdmissionMinFreeHeap = 20 * 1024;
+// Chunked responses and OTA buffers need contiguous allocations, so the
+// largest free block matters more than the total.
+constexpr size_t kAdmissionMinLargestBlock = 12 * 1024;
+constexpr size_t kAdmissionMaxBacklog = 6;
+constexpr unsigned long kOverloadedRetryAfterMs = 2000;
+
+bool isExpensiveCommand(const String &command) {
+  return command == "send" || command == "send/sequence" ||
+         command == "learn/capture" || command == "signals/store" ||
+         command == "runtime/ota/start" || command == "runtime/bench";
+}
+
+bool isOverloaded(String &detail) {
+  const size_t freeHeap = ESP.getFreeHeap();
+  const size_t largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  if (freeHeap < kAdmissionMinFreeHeap ||
+      largestBlock < kAdmissionMinLargestBlock) {
+    detail = String("free_heap=") + String(freeHeap) +
+             " largest_block=" + String(largestBlock);
+    return true;
+  }
+  const size_t backlog = gCommandQueueCount + gIrJobsInFlight;
+  if (backlog >= kAdmissionMaxBacklog) {
+    detail = String("backlog=") + String(backlog);
+    return true;
+  }
+  return false;
+}
+
+bool enqueueIrJob(IrSendJob *job, String &errorCode, String &errorMessage,
+                  int &statusCode, bool &deferred) {
+  if (!irWorkerEnqueueSend(job)) {
+    delete job;
+    errorCode = "queue_full";
+    errorMessage = "IR job queue is full";
+    statusCode = 503;
+    return false;
   }
+  gIrJobsInFlight++;
+  deferred = true;
+  return true;
 }
 
-bool executeSendCommand(JsonObjectConst payload, JsonObject result,
+bool executeSendCommand(const String &hubId, const String &requestId,
+                        JsonObjectConst payload, JsonObject result,
                         String &errorCode, String &errorMessage,
-                        int &statusCode) {
+                        int &statusCode, bool &deferred) {
+  (void)result;
   if (gLearningActive) {
     errorCode = "send_while_learning";
     errorMessage = "Cannot send while learning is active";
@@ -118,12 +303,36 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
   const String mode = String(payload["mode"] | "");
   const String normalizedMode = mode.length() ? mode : "press";
 
-  // Protocol-encoded signals (NEC, Samsung32, SIRC, RC5, RC6, Kaseikyo, JVC).
-  const String signalType = String(payload["encoding"] | "raw");
+  // A send may reference a cached signal instead of carrying the frames —
+  // the descriptor is loaded from NVS and replaces the payload as the source
+  // of signal fields. mode/hold_ms still come from the live payload.
+  JsonDocument cachedSignalDoc(jsonArena());
+  JsonObjectConst signal = payload;
+  const String signalId = String(payload["signal_id"] | "");
+  if (signalId.length()) {
+    if (!isValidSignalCacheId(signalId)) {
+      errorCode = "validation_error";
+      errorMessage = "signal_id is invalid";
+      statusCode = 400;
+      return false;
+    }
+    if (!signalCacheLoad(signalId, cachedSignalDoc)) {
+      errorCode = "signal_not_cached";
+      errorMessage = String("No cached signal for signal_id=") + signalId;
+      statusCode = 404;
+      return false;
+    }
+    signal = cachedSignalDoc.as<JsonObjectConst>();
+  }
+
+  // Signal encodings: "raw" (ASCII "+500 -400" durations), "raw_binary"
+  // (base64 little-endian uint16 durations, advertised in state/agent) and
+  // "protocol" (NEC, Samsung32, SIRC, RC5, RC6, Kaseikyo, JVC).
+  const String signalType = String(signal["encoding"] | "raw");
   if (signalType == "protocol") {
-    const String protocolName = String(payload["protocol"] | "");
-    const String addressStr = String(payload["address"] | "");
-    const String commandHexStr = String(payload["command_hex"] | "");
+    const String protocolName = String(signal["protocol"] | "");
+    const String addressStr = String(signal["address"] | "");
+    const String commandHexStr = String(signal["command_hex"] | "");
     if (protocolName.isEmpty() || addressStr.isEmpty() ||
         commandHexStr.isEmpty()) {
       errorCode = "validation_error";
@@ -133,23 +342,36 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
       return false;
     }
     markActivity();
-    if (!sendFrameProtocol(protocolName, addressStr, commandHexStr)) {
-      errorCode = "runtime_error";
-      errorMessage =
-          String("Unsupported or invalid IR protocol: ") + protocolName;
-      statusCode = 409;
-      return false;
-    }
-    result["mode"] = "press";
-    result["repeats"] = 0;
-    result["gap_us"] = nullptr;
-    return true;
+    IrSendJob *job = new IrSendJob();
+    job->kind = IrJobKind::SendProtocol;
+    job->hubId = hubId;
+    job->requestId = requestId;
+    job->protocolName = protocolName;
+    job->addressStr = addressStr;
+    job->commandStr = commandHexStr;
+    return enqueueIrJob(job, errorCode, errorMessage, statusCode, deferred);
   }
 
+  const bool binaryEncoding = (signalType == "raw_binary");
+  if (signalType != "raw" && !binaryEncoding) {
+    errorCode = "validation_error";
+    errorMessage = String("Unsupported encoding: ") + signalType;
+    statusCode = 400;
+    return false;
+  }
+  // Signal texts stay as pointers into the parsed payload document — for a
+  // chunked multi-KB raw signal that is the copy worth avoiding. The frames
+  // are parsed out before this function returns, so the aliasing is safe.
+  const auto parseFrame = [&](const char *text,
+                              std::vector<uint16_t> &frame) {
+    return binaryEncoding ? parseBinarySignal(text, frame)
+                          : parseRawSignal(text, frame);
+  };
+
   const uint16_t carrierHz =
-      static_cast<uint16_t>(payload["carrier_hz"] | 38000);
-  const String pressInitial = String(payload["press_initial"] | "");
-  if (pressInitial.isEmpty()) {
+      static_cast<uint16_t>(signal["carrier_hz"] | 38000);
+  const char *pressInitial = signal["press_initial"] | "";
+  if (*pressInitial == '\0') {
     errorCode = "validation_error";
     errorMessage = "press_initial is required";
     statusCode = 400;
@@ -157,7 +379,7 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
   }
 
   std::vector<uint16_t> pressFrame;
-  if (!parseRawSignal(pressInitial, pressFrame)) {
+  if (!parseFrame(pressInitial, pressFrame)) {
     errorCode = "validation_error";
     errorMessage = "Invalid press_initial format";
     statusCode = 400;
@@ -167,16 +389,13 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
   markActivity();
 
   if (normalizedMode == "press") {
-    if (!sendFrameRaw(pressFrame, carrierHz)) {
-      errorCode = "runtime_error";
-      errorMessage = "Failed to send press frame";
-      statusCode = 409;
-      return false;
-    }
-    result["mode"] = "press";
-    result["repeats"] = 0;
-    result["gap_us"] = nullptr;
-    return true;
+    IrSendJob *job = new IrSendJob();
+    job->kind = IrJobKind::SendPress;
+    job->hubId = hubId;
+    job->requestId = requestId;
+    job->carrierHz = carrierHz;
+    job->pressFrame = std::move(pressFrame);
+    return enqueueIrJob(job, errorCode, errorMessage, statusCode, deferred);
   }
 
   if (normalizedMode != "hold") {
@@ -194,10 +413,10 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
     return false;
   }
 
-  const String holdInitial = String(payload["hold_initial"] | "");
-  const String holdRepeat = String(payload["hold_repeat"] | "");
-  const int holdGapUs = payload["hold_gap_us"] | 0;
-  if (holdInitial.isEmpty() || holdRepeat.isEmpty() || holdGapUs <= 0) {
+  const char *holdInitial = signal["hold_initial"] | "";
+  const char *holdRepeat = signal["hold_repeat"] | "";
+  const int holdGapUs = signal["hold_gap_us"] | 0;
+  if (*holdInitial == '\0' || *holdRepeat == '\0' || holdGapUs <= 0) {
     errorCode = "validation_error";
     errorMessage = "hold_initial, hold_repeat and hold_gap_us are required";
     statusCode = 400;
@@ -206,54 +425,142 @@ bool executeSendCommand(JsonObjectConst payload, JsonObject result,
 
   std::vector<uint16_t> holdInitialFrame;
   std::vector<uint16_t> holdRepeatFrame;
-  if (!parseRawSignal(holdInitial, holdInitialFrame) ||
-      !parseRawSignal(holdRepeat, holdRepeatFrame)) {
+  if (!parseFrame(holdInitial, holdInitialFrame) ||
+      !parseFrame(holdRepeat, holdRepeatFrame)) {
     errorCode = "validation_error";
     errorMessage = "Invalid hold frame format";
     statusCode = 400;
     return false;
   }
 
-  if (!sendFrameRaw(holdInitialFrame, carrierHz)) {
+  IrSendJob *job = new IrSendJob();
+  job->kind = IrJobKind::SendHold;
+  job->hubId = hubId;
+  job->requestId = requestId;
+  job->carrierHz = carrierHz;
+  job->holdInitialFrame = std::move(holdInitialFrame);
+  job->holdRepeatFrame = std::move(holdRepeatFrame);
+  job->holdMs = holdMs;
+  job->holdGapUs = holdGapUs;
+  return enqueueIrJob(job, errorCode, errorMessage, statusCode, deferred);
+}
+
+constexpr size_t kMaxSequenceSteps = 16;
+
+// Resolves one step of a send/sequence payload into an executable frame.
+// Steps carry the same signal fields as a send command (or a signal_id
+// reference into the cache) plus gap_us/gap_ms before the next step.
+bool resolveSequenceStep(JsonObjectConst stepPayload, IrSequenceStep &step,
+                         String &errorMessage) {
+  JsonDocument cachedSignalDoc(jsonArena());
+  JsonObjectConst signal = stepPayload;
+  const String signalId = String(stepPayload["signal_id"] | "");
+  if (signalId.length()) {
+    if (!isValidSignalCacheId(signalId) ||
+        !signalCacheLoad(signalId, cachedSignalDoc)) {
+      errorMessage = String("No cached signal for signal_id=") + signalId;
+      return false;
+    }
+    signal = cachedSignalDoc.as<JsonObjectConst>();
+  }
+
+  uint32_t gapUs = stepPayload["gap_us"] | 0;
+  if (gapUs == 0) {
+    gapUs = static_cast<uint32_t>(stepPayload["gap_ms"] | 0) * 1000UL;
+  }
+  step.gapUs = gapUs;
+
+  const String signalType = String(signal["encoding"] | "raw");
+  if (signalType == "protocol") {
+    step.isProtocol = true;
+    step.protocolName = String(signal["protocol"] | "");
+    step.addressStr = String(signal["address"] | "");
+    step.commandStr = String(signal["command_hex"] | "");
+    if (step.protocolName.isEmpty() || step.addressStr.isEmpty() ||
+        step.commandStr.isEmpty()) {
+      errorMessage = "protocol, address, and command_hex are required for "
+                     "protocol steps";
+      return false;
+    }
+    return true;
+  }
+
+  const bool binaryEncoding = (signalType == "raw_binary");
+  if (signalType != "raw" && !binaryEncoding) {
+    errorMessage = String("Unsupported encoding: ") + signalType;
+    return false;
+  }
+  step.isProtocol = false;
+  step.carrierHz = static_cast<uint16_t>(signal["carrier_hz"] | 38000);
+  const char *pressInitial = signal["press_initial"] | "";
+  const bool parsed = binaryEncoding
+                          ? parseBinarySignal(pressInitial, step.frame)
+                          : parseRawSignal(pressInitial, step.frame);
+  if (!parsed) {
+    errorMessage = "Invalid press_initial format";
+    return false;
+  }
+  return true;
+}
+
+bool executeSendSequenceCommand(const String &hubId, const String &requestId,
+                                JsonObjectConst payload, String &errorCode,
+                                String &errorMessage, int &statusCode,
+                                bool &deferred) {
+  if (gLearningActive) {
+    errorCode = "send_while_learning";
+    errorMessage = "Cannot send while learning is active";
+    statusCode = 409;
+    return false;
+  }
+  if (!canSend()) {
     errorCode = "runtime_error";
-    errorMessage = "Failed to send hold initial frame";
+    errorMessage = "IR sender is not available";
     statusCode = 409;
     return false;
   }
 
-  const uint32_t targetUs = static_cast<uint32_t>(holdMs) * 1000UL;
-  const uint32_t initialUs = frameDurationUs(holdInitialFrame);
-  const uint32_t repeatUs = frameDurationUs(holdRepeatFrame);
-  const uint32_t periodUs = repeatUs + static_cast<uint32_t>(holdGapUs);
-  const uint32_t remainingUs =
-      (targetUs > initialUs) ? (targetUs - initialUs) : 0;
-  uint32_t repeatCount = 1;
-  if (periodUs > 0 && remainingUs > 0) {
-    repeatCount = static_cast<uint32_t>(std::ceil(
-        static_cast<float>(remainingUs) / static_cast<float>(periodUs)));
-    if (repeatCount == 0) {
-      repeatCount = 1;
-    }
+  const JsonArrayConst steps = payload["steps"].as<JsonArrayConst>();
+  if (steps.isNull() || steps.size() == 0) {
+    errorCode = "validation_error";
+    errorMessage = "steps must be a non-empty array";
+    statusCode = 400;
+    return false;
+  }
+  if (steps.size() > kMaxSequenceSteps) {
+    errorCode = "validation_error";
+    errorMessage = String("steps must contain at most ") +
+                   String(kMaxSequenceSteps) + " entries";
+    statusCode = 400;
+    return false;
   }
 
-  for (uint32_t i = 0; i < repeatCount; i++) {
-    delayUsWithYield(static_cast<uint32_t>(holdGapUs));
-    if (!sendFrameRaw(holdRepeatFrame, carrierHz)) {
-      errorCode = "runtime_error";
-      errorMessage = "Failed to send hold repeat frame";
-      statusCode = 409;
+  IrSendJob *job = new IrSendJob();
+  job->kind = IrJobKind::SendSequence;
+  job->hubId = hubId;
+  job->requestId = requestId;
+  job->steps.reserve(steps.size());
+  size_t stepIndex = 0;
+  for (JsonObjectConst stepPayload : steps) {
+    IrSequenceStep step;
+    String stepError;
+    if (!resolveSequenceStep(stepPayload, step, stepError)) {
+      delete job;
+      errorCode = "validation_error";
+      errorMessage = String("Step ") + String(stepIndex) + ": " + stepError;
+      statusCode = 400;
       return false;
     }
+    job->steps.push_back(std::move(step));
+    stepIndex++;
   }
 
-  result["mode"] = "hold";
-  result["hold_ms"] = holdMs;
-  result["gap_us"] = holdGapUs;
-  result["repeats"] = repeatCount;
-  return true;
+  markActivity();
+  return enqueueIrJob(job, errorCode, errorMessage, statusCode, deferred);
 }
 
-bool executeLearnCaptureCommand(JsonObjectConst payload, JsonObject result,
+bool executeLearnCaptureCommand(const String &hubId, const String &requestId,
+                                JsonObjectConst payload, JsonObject result,
                                 String &errorCode, String &errorMessage,
                                 int &statusCode) {
   if (!gLearningActive) {
@@ -268,6 +575,12 @@ bool executeLearnCaptureCommand(JsonObjectConst payload, JsonObject result,
     statusCode = 409;
     return false;
   }
+  if (gPendingLearnCapture.active) {
+    errorCode = "capture_in_progress";
+    errorMessage = "A learn capture is already running";
+    statusCode = 409;
+    return false;
+  }
   const int timeoutMs = payload["timeout_ms"] | 0;
   if (timeoutMs <= 0) {
     errorCode = "validation_error";
@@ -275,28 +588,189 @@ bool executeLearnCaptureCommand(JsonObjectConst payload, JsonObject result,
     statusCode = 400;
     return false;
   }
+  const bool burst = payload["burst"] | false;
+  const int windowMs = payload["window_ms"] | 1000;
+  if (burst && (windowMs < 100 || windowMs > 10000)) {
+    errorCode = "validation_error";
+    errorMessage = "window_ms must be between 100 and 10000";
+    statusCode = 400;
+    return false;
+  }
 
   markActivity();
   applyLearningReceiverState();
+  // Discard any stale frame left in the receiver buffer from before this
+  // capture request, so the result is a signal pressed after the request.
+  if (gIrReceiver->decode(&gDecodeResults)) {
+    gIrReceiver->resume();
+  }
 
-  const unsigned long startMs = millis();
-  while (millis() - startMs < static_cast<unsigned long>(timeoutMs)) {
-    if (gIrReceiver->decode(&gDecodeResults)) {
-      const String raw = buildRawTextFromDecode(gDecodeResults);
-      gIrReceiver->resume();
-      result["raw"] = raw;
-      result["stdout"] = "";
-      result["stderr"] = "";
-      return true;
-    }
-    gMqttClient.loop();
-    delay(2);
+  gPendingLearnCapture.active = true;
+  gPendingLearnCapture.burst = burst;
+  gPendingLearnCapture.hubId = hubId;
+  gPendingLearnCapture.requestId = requestId;
+  gPendingLearnCapture.deadlineMs = millis() + static_cast<unsigned long>(timeoutMs);
+  gPendingLearnCapture.windowMs = static_cast<unsigned long>(windowMs);
+  gPendingLearnCapture.windowEndMs = 0;
+  gPendingLearnCapture.burstTickUs = 0;
+  gPendingLearnCapture.frames.clear();
+  gPendingLearnCapture.frameAtMs.clear();
+
+  result["accepted"] = true;
+  result["timeout_ms"] = timeoutMs;
+  if (burst) {
+    result["window_ms"] = windowMs;
+  }
+  return true;
+}
+
+void publishLearnCaptureError(const String &errorCode,
+                              const String &errorMessage, int statusCode) {
+  sendCommandResponse(
+      gPendingLearnCapture.hubId, gPendingLearnCapture.requestId, false,
+      [](JsonObject) {}, errorCode, errorMessage, statusCode);
+  gPendingLearnCapture.active = false;
+  gPendingLearnCapture.frames.clear();
+  gPendingLearnCapture.frameAtMs.clear();
+}
+
+// Publishes the buffered burst window as one response: every frame with its
+// gap to the previous one, aggregate gap statistics, and whether the trailing
+// frames are one repeating pattern (the shape of a held button: one initial
+// frame followed by identical repeats).
+void publishBurstCaptureResult() {
+  sendCommandResponse(
+      gPendingLearnCapture.hubId, gPendingLearnCapture.requestId, true,
+      [&](JsonObject responseResult) {
+        const std::vector<String> &frames = gPendingLearnCapture.frames;
+        const std::vector<unsigned long> &atMs = gPendingLearnCapture.frameAtMs;
+        responseResult["mode"] = "burst";
+        responseResult["frame_count"] = frames.size();
+
+        JsonArray frameArray = responseResult["frames"].to<JsonArray>();
+        unsigned long gapMinMs = 0;
+        unsigned long gapMaxMs = 0;
+        unsigned long gapSumMs = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+          JsonObject entry = frameArray.add<JsonObject>();
+          // Collapse duplicate frames into a reference to their first
+          // occurrence — a multi-frame AC capture is mostly repeats, and the
+          // references keep the response under the chunking threshold.
+          size_t firstIndex = i;
+          for (size_t j = 0; j < i; j++) {
+            if (frames[j] == frames[i]) {
+              firstIndex = j;
+              break;
+            }
+          }
+          if (firstIndex != i) {
+            entry["repeat_of"] = firstIndex;
+          } else {
+            entry["raw"] = frames[i];
+          }
+          if (i == 0) {
+            entry["gap_ms"] = nullptr;
+            continue;
+          }
+          const unsigned long gapMs = atMs[i] - atMs[i - 1];
+          entry["gap_ms"] = gapMs;
+          gapSumMs += gapMs;
+          if (gapMinMs == 0 || gapMs < gapMinMs) {
+            gapMinMs = gapMs;
+          }
+          if (gapMs > gapMaxMs) {
+            gapMaxMs = gapMs;
+          }
+        }
+        if (frames.size() > 1) {
+          JsonObject gapStats = responseResult["gap_stats"].to<JsonObject>();
+          gapStats["min_ms"] = gapMinMs;
+          gapStats["max_ms"] = gapMaxMs;
+          gapStats["avg_ms"] = gapSumMs / (frames.size() - 1);
+        }
+
+        // Repeat detection: all frames after the first identical to each other.
+        bool repeatDetected = frames.size() >= 3;
+        for (size_t i = 2; repeatDetected && i < frames.size(); i++) {
+          repeatDetected = (frames[i] == frames[1]);
+        }
+        JsonObject repeat = responseResult["repeat"].to<JsonObject>();
+        repeat["detected"] = repeatDetected;
+        if (repeatDetected) {
+          repeat["count"] = frames.size() - 1;
+        }
+      },
+      "", "", 0);
+  gPendingLearnCapture.active = false;
+  gPendingLearnCapture.frames.clear();
+  gPendingLearnCapture.frameAtMs.clear();
+  markActivity();
+}
+
+// Cancels a pending capture, e.g. when learn/stop arrives mid-window.
+void cancelPendingLearnCapture() {
+  if (!gPendingLearnCapture.active) {
+    return;
   }
+  publishLearnCaptureError("capture_cancelled", "Learn capture cancelled", 409);
+}
 
-  errorCode = "timeout";
-  errorMessage = "Learn capture timed out";
-  statusCode = 408;
-  return false;
+// Drives the asynchronous capture from processBackgroundTasks(): publishes
+// the decoded frame as soon as one arrives, or a timeout error.
+void processPendingLearnCapture() {
+  if (!gPendingLearnCapture.active) {
+    return;
+  }
+  if (!gLearningActive || !canLearn()) {
+    publishLearnCaptureError("capture_cancelled", "Learning session ended", 409);
+    return;
+  }
+  if (gIrReceiver->decode(&gDecodeResults)) {
+    // Quantizing to the protocol tick denoises the capture and makes repeated
+    // frames byte-identical, which both shrinks the response and lets the
+    // burst path collapse repeats into references. Bursts share one tick
+    // across the window — per-frame estimates drift with jitter and would
+    // quantize repeats of the same button to different strings.
+    const String rawText = buildRawTextFromDecode(gDecodeResults);
+    const String raw = gPendingLearnCapture.burst
+                           ? quantizeRawSignal(rawText, gPendingLearnCapture.burstTickUs)
+                           : quantizeRawSignal(rawText);
+    gIrReceiver->resume();
+    if (!gPendingLearnCapture.burst) {
+      sendCommandResponse(
+          gPendingLearnCapture.hubId, gPendingLearnCapture.requestId, true,
+          [&](JsonObject responseResult) {
+            responseResult["raw"] = raw;
+            responseResult["stdout"] = "";
+            responseResult["stderr"] = "";
+          },
+          "", "", 0);
+      gPendingLearnCapture.active = false;
+      markActivity();
+      return;
+    }
+    // Burst mode: buffer the frame and keep the window open. The first frame
+    // starts the window clock; a full buffer closes it early.
+    const unsigned long now = millis();
+    if (gPendingLearnCapture.frames.empty()) {
+      gPendingLearnCapture.windowEndMs = now + gPendingLearnCapture.windowMs;
+    }
+    gPendingLearnCapture.frames.push_back(raw);
+    gPendingLearnCapture.frameAtMs.push_back(now);
+    if (gPendingLearnCapture.frames.size() >= kMaxBurstFrames) {
+      publishBurstCaptureResult();
+    }
+    return;
+  }
+  if (gPendingLearnCapture.burst && !gPendingLearnCapture.frames.empty()) {
+    if (millis() >= gPendingLearnCapture.windowEndMs) {
+      publishBurstCaptureResult();
+    }
+    return;
+  }
+  if (millis() >= gPendingLearnCapture.deadlineMs) {
+    publishLearnCaptureError("timeout", "Learn capture timed out", 408);
+  }
 }
 
 bool executeRuntimeConfigSet(JsonObjectConst payload, JsonObject result,
@@ -304,15 +778,29 @@ bool executeRuntimeConfigSet(JsonObjectConst payload, JsonObject result,
                              int &statusCode) {
   const JsonVariantConst rxPin = payload["ir_rx_pin"];
   const JsonVariantConst txPin = payload["ir_tx_pin"];
+  const JsonVariantConst powerProfile = payload["power_profile"];
   bool hasRx = !rxPin.isUnbound();
   bool hasTx = !txPin.isUnbound();
-  if (!hasRx && !hasTx) {
+  bool hasPowerProfile = !powerProfile.isUnbound();
+  if (!hasRx && !hasTx && !hasPowerProfile) {
     errorCode = "validation_error";
-    errorMessage = "At least one pin must be provided";
+    errorMessage = "At least one of ir_rx_pin, ir_tx_pin or power_profile must be provided";
     statusCode = 400;
     return false;
   }
 
+  String nextPowerProfile = gRuntimeConfig.powerProfile;
+  if (hasPowerProfile) {
+    nextPowerProfile = String(powerProfile | "");
+    nextPowerProfile.trim();
+    if (!isValidPowerProfile(nextPowerProfile)) {
+      errorCode = "validation_error";
+      errorMessage = "power_profile must be performance, balanced or battery";
+      statusCode = 400;
+      return false;
+    }
+  }
+
   int nextRx = gRuntimeConfig.irRxPin;
   int nextTx = gRuntimeConfig.irTxPin;
   if (hasRx) {
@@ -346,12 +834,14 @@ bool executeRuntimeConfigSet(JsonObjectConst payload, JsonObject result,
     }
   }
 
-  const bool changed =
+  const bool pinsChanged =
       (nextRx != gRuntimeConfig.irRxPin) || (nextTx != gRuntimeConfig.irTxPin);
+  const bool profileChanged = nextPowerProfile != gRuntimeConfig.powerProfile;
   gRuntimeConfig.irRxPin = nextRx;
   gRuntimeConfig.irTxPin = nextTx;
+  gRuntimeConfig.powerProfile = nextPowerProfile;
   saveRebootRequired(false);
-  if (changed) {
+  if (pinsChanged) {
     // RMT hardware teardown (rmt_driver_uninstall) is not safe at runtime
     // regardless of context. Persist the new pins to NVS and publish the
     // updated state before rebooting so setup() initialises IR hardware with
@@ -360,11 +850,16 @@ bool executeRuntimeConfigSet(JsonObjectConst payload, JsonObject result,
     publishState();
     scheduleReboot(kRebootDelayMs);
   } else {
+    if (profileChanged) {
+      // A profile switch takes effect on the next idle transition; no reboot.
+      saveRuntimeConfig();
+    }
     publishState();
   }
 
   result["ir_rx_pin"] = gRuntimeConfig.irRxPin;
   result["ir_tx_pin"] = gRuntimeConfig.irTxPin;
+  result["power_profile"] = gRuntimeConfig.powerProfile;
   result["reboot_required"] = gRebootRequired;
   return true;
 }
@@ -471,6 +966,143 @@ bool executeRuntimeOtaCancel(JsonObject result, String &errorCode,
   return true;
 }
 
+// On-device microbenchmarks for the command hot paths. Runs on the command
+// lane so timings reflect the same heap, cache and flash conditions a real
+// command sees; every figure is an average over `iterations` runs.
+bool executeRuntimeBench(JsonObjectConst payload, JsonObject result,
+                         String &errorCode, String &errorMessage,
+                         int &statusCode) {
+  const int iterations = payload["iterations"] | 20;
+  if (iterations < 1 || iterations > 100) {
+    errorCode = "validation_error";
+    errorMessage = "iterations must be between 1 and 100";
+    statusCode = 400;
+    return false;
+  }
+  result["iterations"] = iterations;
+
+  // Synthetic 200-edge NEC-like frame shared by the parse and dry-run benches.
+  String rawFrame;
+  rawFrame.reserve(200 * 5);
+  for (int i = 0; i < 100; i++) {
+    rawFrame += (i % 2 == 0) ? "560 1690 " : "560 560 ";
+  }
+  rawFrame.trim();
+
+  {
+    std::vector<uint16_t> frame;
+    const int64_t startUs = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) {
+      frame.clear();
+      parseRawSignal(rawFrame.c_str(), frame);
+    }
+    const int64_t totalUs = esp_timer_get_time() - startUs;
+    JsonObject parseRaw = result["parse_raw"].to<JsonObject>();
+    parseRaw["edges"] = 200;
+    parseRaw["avg_us"] = static_cast<uint32_t>(totalUs / iterations);
+    if (totalUs > 0) {
+      parseRaw["edges_per_s"] = static_cast<uint32_t>(
+          (static_cast<int64_t>(iterations) * 200 * 1000000LL) / totalUs);
+    }
+  }
+
+  {
+    // Round-trip of a representative send command envelope.
+    JsonDocument doc;
+    doc["request_id"] = "bench-request";
+    doc["hub_id"] = gPairingHubId.isEmpty() ? "bench-hub" : gPairingHubId;
+    JsonObject signal = doc["signal"].to<JsonObject>();
+    signal["encoding"] = "raw";
+    signal["carrier_hz"] = 38000;
+    signal["press_initial"] = rawFrame;
+    String text;
+    int64_t serializeUs = 0;
+    int64_t deserializeUs = 0;
+    for (int i = 0; i < iterations; i++) {
+      text = "";
+      const int64_t t0 = esp_timer_get_time();
+      serializeJson(doc, text);
+      const int64_t t1 = esp_timer_get_time();
+      JsonDocument parsed;
+      deserializeJson(parsed, text);
+      serializeUs += t1 - t0;
+      deserializeUs += esp_timer_get_time() - t1;
+    }
+    JsonObject json = result["json"].to<JsonObject>();
+    json["bytes"] = text.length();
+    json["serialize_avg_us"] = static_cast<uint32_t>(serializeUs / iterations);
+    json["deserialize_avg_us"] =
+        static_cast<uint32_t>(deserializeUs / iterations);
+  }
+
+  {
+    // QoS 0 publish to the non-retained diagnostics topic: measures the
+    // client + TCP write path, not a broker ack (PubSubClient has none at
+    // QoS 0). Capped at 5 publishes to keep bench noise off the broker.
+    const int publishRuns = (iterations < 5) ? iterations : 5;
+    int64_t publishUs = 0;
+    int publishes = 0;
+    if (gMqttClient.connected()) {
+      for (int i = 0; i < publishRuns; i++) {
+        const int64_t t0 = esp_timer_get_time();
+        gMqttClient.publish(topicStateDiagnostics().c_str(), "{\"bench\":true}",
+                            false);
+        publishUs += esp_timer_get_time() - t0;
+        publishes++;
+      }
+    }
+    JsonObject mqtt = result["mqtt"].to<JsonObject>();
+    mqtt["publishes"] = publishes;
+    if (publishes > 0) {
+      mqtt["publish_avg_us"] = static_cast<uint32_t>(publishUs / publishes);
+    }
+  }
+
+  {
+    Preferences prefs;
+    if (prefs.begin(kPrefsNamespace, false)) {
+      int64_t writeUs = 0;
+      int64_t readUs = 0;
+      for (int i = 0; i < iterations; i++) {
+        const int64_t t0 = esp_timer_get_time();
+        // The value changes every run so NVS cannot skip the write.
+        prefs.putUInt("bench_tmp", static_cast<uint32_t>(i));
+        const int64_t t1 = esp_timer_get_time();
+        prefs.getUInt("bench_tmp", 0);
+        writeUs += t1 - t0;
+        readUs += esp_timer_get_time() - t1;
+      }
+      prefs.remove("bench_tmp");
+      prefs.end();
+      JsonObject nvs = result["nvs"].to<JsonObject>();
+      nvs["write_avg_us"] = static_cast<uint32_t>(writeUs / iterations);
+      nvs["read_avg_us"] = static_cast<uint32_t>(readUs / iterations);
+    }
+  }
+
+  {
+    // The send pipeline minus the emit: raw parse plus job construction —
+    // everything executeSendCommand does before handing off to the worker.
+    int64_t dryRunUs = 0;
+    for (int i = 0; i < iterations; i++) {
+      const int64_t t0 = esp_timer_get_time();
+      std::vector<uint16_t> frame;
+      if (parseRawSignal(rawFrame.c_str(), frame)) {
+        IrSendJob *job = new IrSendJob();
+        job->kind = IrJobKind::SendPress;
+        job->carrierHz = 38000;
+        job->pressFrame = std::move(frame);
+        delete job;
+      }
+      dryRunUs += esp_timer_get_time() - t0;
+    }
+    result["send_dryrun"].to<JsonObject>()["avg_us"] =
+        static_cast<uint32_t>(dryRunUs / iterations);
+  }
+
+  return true;
+}
+
 void processPendingOtaRequest() {
   if (!gPendingOtaRequest.active || gPendingOtaRequest.running) {
     return;
@@ -534,8 +1166,138 @@ void processPendingOtaRequest() {
   scheduleReboot(kRebootDelayMs);
 }
 
+// Publishes responses for IR jobs completed by the worker task. Runs on
+// core 0 so all MQTT traffic stays on a single task.
+void processIrWorkerResults() {
+  // Results the worker had to drop still retire their in-flight slot; the
+  // hub times those requests out, but admission control must not count them
+  // as backlog forever.
+  const uint32_t dropped = irWorkerTakeDroppedResultCount();
+  for (uint32_t i = 0; i < dropped; i++) {
+    if (gIrJobsInFlight > 0) {
+      gIrJobsInFlight--;
+    }
+    logWarn("runtime", "IR job result dropped: result queue full", "queue_full");
+  }
+  while (IrJobResult *jobResult = irWorkerTakeResult()) {
+    if (gIrJobsInFlight > 0) {
+      gIrJobsInFlight--;
+    }
+    sendCommandResponse(
+        jobResult->hubId, jobResult->requestId, jobResult->ok,
+        [&](JsonObject responseResult) {
+          responseResult["mode"] = jobResult->mode;
+          responseResult["repeats"] = jobResult->repeats;
+          if (jobResult->hasGap) {
+            responseResult["hold_ms"] = jobResult->holdMs;
+            responseResult["gap_us"] = jobResult->gapUs;
+          } else {
+            responseResult["gap_us"] = nullptr;
+          }
+        },
+        jobResult->errorCode, jobResult->errorMessage, jobResult->statusCode);
+    if (jobResult->ok) {
+      logDebug("runtime", String("Command handled command=") + jobResult->command +
+                              " request_id=" + jobResult->requestId + " ok=true");
+    } else {
+      const String code =
+          jobResult->errorCode.length() ? jobResult->errorCode : "runtime_error";
+      logWarn("runtime",
+              String("Command failed command=") + jobResult->command +
+                  " request_id=" + jobResult->requestId + " error=" + code,
+              code);
+    }
+    delete jobResult;
+  }
+}
+
+bool pushQueuedCommand(QueuedCommand* queue, size_t capacity, size_t head,
+                       size_t& count, const String& command,
+                       JsonObjectConst payload) {
+  if (count >= capacity) {
+    return false;
+  }
+  QueuedCommand& slot = queue[(head + count) % capacity];
+  slot.command = command;
+  slot.payloadJson = "";
+  slot.payloadJson.reserve(measureJson(payload));
+  serializeJson(payload, slot.payloadJson);
+  slot.receivedAtMs = millis();
+  slot.receivedAtUs = esp_timer_get_time();
+  count++;
+  return true;
+}
+
+bool popQueuedCommand(QueuedCommand* queue, size_t capacity, size_t& head,
+                      size_t& count, QueuedCommand& out) {
+  if (count == 0) {
+    return false;
+  }
+  out = queue[head];
+  queue[head].command = "";
+  queue[head].payloadJson = "";
+  head = (head + 1) % capacity;
+  count--;
+  return true;
+}
+
+// Drains the control lane completely, then at most one regular command per
+// call so background work keeps a bounded slice of each loop iteration.
+void processQueuedCommands() {
+  QueuedCommand queued;
+  while (popQueuedCommand(gControlQueue, kControlQueueCapacity,
+                          gControlQueueHead, gControlQueueCount, queued)) {
+    jsonArenaReset();  // The previous command's documents are gone by now.
+    JsonDocument doc(jsonArena());
+    if (deserializeJson(doc, queued.payloadJson) == DeserializationError::Ok) {
+      gActiveCommandReceivedUs = queued.receivedAtUs;
+      handleCommand(queued.command, doc.as<JsonObjectConst>());
+      gActiveCommandReceivedUs = 0;
+    }
+  }
+  if (popQueuedCommand(gCommandQueue, kCommandQueueCapacity, gCommandQueueHead,
+                       gCommandQueueCount, queued)) {
+    jsonArenaReset();  // The previous command's documents are gone by now.
+    JsonDocument doc(jsonArena());
+    if (deserializeJson(doc, queued.payloadJson) == DeserializationError::Ok) {
+      gActiveCommandReceivedUs = queued.receivedAtUs;
+      handleCommand(queued.command, doc.as<JsonObjectConst>());
+      gActiveCommandReceivedUs = 0;
+    }
+  }
+}
+
 } // namespace
 
+void enqueueCommand(const String &command, JsonObjectConst payload) {
+  const bool control = isControlCommand(command);
+  const bool accepted =
+      control ? pushQueuedCommand(gControlQueue, kControlQueueCapacity,
+                                  gControlQueueHead, gControlQueueCount,
+                                  command, payload)
+              : pushQueuedCommand(gCommandQueue, kCommandQueueCapacity,
+                                  gCommandQueueHead, gCommandQueueCount,
+                                  command, payload);
+  if (accepted) {
+    return;
+  }
+
+  // Queue full — tell the hub explicitly instead of letting the command rot
+  // in TCP backpressure until the request times out.
+  const String requestId = String(payload["request_id"] | "");
+  const String hubId = String(payload["hub_id"] | "");
+  logWarn("runtime",
+          String("Command queue full command=") + command +
+              " request_id=" + requestId,
+          "queue_full");
+  if (requestId.isEmpty() || hubId.isEmpty() || !isHubAuthorized(hubId)) {
+    return;
+  }
+  sendCommandResponse(
+      hubId, requestId, false, [](JsonObject) {}, "queue_full",
+      "Command queue is full", 503);
+}
+
 void handleCommand(const String &command, JsonObjectConst payload) {
   const String requestId = String(payload["request_id"] | "");
   const String hubId = String(payload["hub_id"] | "");
@@ -552,17 +1314,35 @@ void handleCommand(const String &command, JsonObjectConst payload) {
     return;
   }
 
+  String overloadDetail;
+  if (isExpensiveCommand(command) && isOverloaded(overloadDetail)) {
+    logWarn("runtime",
+            String("Rejecting command under load command=") + command +
+                " request_id=" + requestId + " " + overloadDetail,
+            "overloaded");
+    sendCommandResponse(
+        hubId, requestId, false, [](JsonObject) {}, "overloaded",
+        String("Agent overloaded: ") + overloadDetail, 503,
+        kOverloadedRetryAfterMs);
+    return;
+  }
+
+  const int64_t execStartUs = esp_timer_get_time();
   String errorCode;
   String errorMessage;
   int statusCode = 500;
   bool commandOk = false;
   bool shouldReboot = false;
-  JsonDocument resultDoc;
+  bool deferred = false;
+  JsonDocument resultDoc(jsonArena());
   JsonObject result = resultDoc.to<JsonObject>();
 
   if (command == "send") {
-    commandOk = executeSendCommand(payload, result, errorCode, errorMessage,
-                                   statusCode);
+    commandOk = executeSendCommand(hubId, requestId, payload, result, errorCode,
+                                   errorMessage, statusCode, deferred);
+  } else if (command == "send/sequence") {
+    commandOk = executeSendSequenceCommand(hubId, requestId, payload, errorCode,
+                                           errorMessage, statusCode, deferred);
   } else if (command == "learn/start") {
     gLearningActive = true;
     markActivity();
@@ -570,13 +1350,51 @@ void handleCommand(const String &command, JsonObjectConst payload) {
     result["ok"] = true;
     commandOk = true;
   } else if (command == "learn/stop") {
+    cancelPendingLearnCapture();
     gLearningActive = false;
     applyLearningReceiverState();
     result["ok"] = true;
     commandOk = true;
   } else if (command == "learn/capture") {
-    commandOk = executeLearnCaptureCommand(payload, result, errorCode,
-                                           errorMessage, statusCode);
+    commandOk = executeLearnCaptureCommand(hubId, requestId, payload, result,
+                                           errorCode, errorMessage, statusCode);
+  } else if (command == "signals/store") {
+    const String signalId = String(payload["signal_id"] | "");
+    const JsonObjectConst signal = payload["signal"].as<JsonObjectConst>();
+    if (!isValidSignalCacheId(signalId) || signal.isNull()) {
+      commandOk = false;
+      errorCode = "validation_error";
+      errorMessage = "signal_id (1-15 chars) and signal object are required";
+      statusCode = 400;
+    } else {
+      size_t storedBytes = 0;
+      if (signalCacheStore(signalId, signal, storedBytes)) {
+        result["signal_id"] = signalId;
+        result["stored_bytes"] = storedBytes;
+        commandOk = true;
+      } else {
+        commandOk = false;
+        errorCode = "runtime_error";
+        errorMessage = "Failed to persist signal to NVS";
+        statusCode = 507;
+      }
+    }
+  } else if (command == "signals/evict") {
+    const String signalId = String(payload["signal_id"] | "");
+    if (!isValidSignalCacheId(signalId)) {
+      commandOk = false;
+      errorCode = "validation_error";
+      errorMessage = "signal_id is required";
+      statusCode = 400;
+    } else {
+      result["signal_id"] = signalId;
+      result["evicted"] = signalCacheEvict(signalId);
+      commandOk = true;
+    }
+  } else if (command == "signals/clear") {
+    signalCacheClear();
+    result["cleared"] = true;
+    commandOk = true;
   } else if (command == "runtime/debug/get") {
     result["debug"] = gDebugEnabled;
     commandOk = true;
@@ -613,6 +1431,9 @@ void handleCommand(const String &command, JsonObjectConst payload) {
   } else if (command == "runtime/ota/cancel") {
     commandOk =
         executeRuntimeOtaCancel(result, errorCode, errorMessage, statusCode);
+  } else if (command == "runtime/bench") {
+    commandOk =
+        executeRuntimeBench(payload, result, errorCode, errorMessage, statusCode);
   } else {
     commandOk = false;
     errorCode = "validation_error";
@@ -620,10 +1441,23 @@ void handleCommand(const String &command, JsonObjectConst payload) {
     statusCode = 400;
   }
 
+  if (deferred) {
+    // The IR worker owns the job now; the response is published from
+    // processBackgroundTasks() once the job result arrives. The latency
+    // sample for deferred commands covers receive -> worker hand-off.
+    metricsRecordCommand(command, gActiveCommandReceivedUs, execStartUs,
+                         esp_timer_get_time());
+    logDebug("runtime", String("Command queued command=") + command +
+                            " request_id=" + requestId);
+    return;
+  }
+
   sendCommandResponse(
       hubId, requestId, commandOk,
       [&](JsonObject responseResult) { responseResult.set(result); }, errorCode,
       errorMessage, statusCode);
+  metricsRecordCommand(command, gActiveCommandReceivedUs, execStartUs,
+                       esp_timer_get_time());
 
   if (commandOk) {
     logDebug("runtime", String("Command handled command=") + command +
@@ -641,6 +1475,30 @@ void handleCommand(const String &command, JsonObjectConst payload) {
   }
 }
 
-void processBackgroundTasks() { processPendingOtaRequest(); }
+void processBackgroundTasks() {
+  processQueuedCommands();
+  processIrWorkerResults();
+  processPendingLearnCapture();
+  processPendingOtaRequest();
+  processTransferTimeouts();
+}
+
+size_t pendingWorkDepth() {
+  return gCommandQueueCount + gControlQueueCount + gIrJobsInFlight;
+}
+
+unsigned long backgroundTaskMaxSleepMs() {
+  if (gCommandQueueCount > 0 || gControlQueueCount > 0) {
+    return 0;
+  }
+  if (gPendingOtaRequest.active && !gPendingOtaRequest.running) {
+    return 0;
+  }
+  if (gPendingLearnCapture.active || gIrJobsInFlight > 0) {
+    // Receiver decode and worker results are polled, not event-driven.
+    return 5;
+  }
+  return ULONG_MAX;
+}
 
 } // namespace agent
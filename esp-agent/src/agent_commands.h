@@ -6,7 +6,25 @@
 
 namespace agent {
 
+// Queues an inbound command for execution from processBackgroundTasks().
+// Control commands (learn/stop, runtime/ota/cancel, runtime/reboot) take a
+// priority lane and jump ahead of queued send/capture work; a full queue is
+// answered with a queue_full error instead of silent TCP backpressure.
+void enqueueCommand(const String& command, JsonObjectConst payload);
+
+// Executes a command immediately. Command intake should go through
+// enqueueCommand(); this is the dispatch path used by the queue drain.
 void handleCommand(const String& command, JsonObjectConst payload);
+
 void processBackgroundTasks();
 
+// Backlog depth (queued commands + IR jobs awaiting results) — feeds the
+// diagnostics load block so the hub can pace the fleet.
+size_t pendingWorkDepth();
+
+// Longest the main loop may block before processBackgroundTasks() must run
+// again: 0 while commands or a pending OTA request wait, a few ms while a
+// learn capture or an in-flight IR job needs polling, ULONG_MAX when idle.
+unsigned long backgroundTaskMaxSleepMs();
+
 }  // namespace agent
@@ -1,18 +1,122 @@
 #include "agent_ir.h"
 
+#include "codec/ir_codec.h"
+
 #include "agent_state.h"
 
 #include <IRremoteESP8266.h>
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <driver/rmt.h>
+#include <mbedtls/base64.h>
+#include <vector>
 
 namespace agent {
 
 namespace {
+
 bool gIrReceiverEnabled = false;
+
+// RMT transmit backend — frames are handed to the peripheral as item arrays,
+// so emission is hardware-timed (no jitter from WiFi interrupts) and the CPU
+// is free while the frame goes out. Falls back to IRremoteESP8266's bit-bang
+// sendRaw when the driver cannot be installed.
+constexpr rmt_channel_t kRmtTxChannel = RMT_CHANNEL_0;
+constexpr uint8_t kRmtClkDiv = 80;           // 80 MHz APB / 80 = 1 us per tick
+constexpr uint32_t kRmtMaxItemDurationUs = 32767;
+constexpr uint8_t kRmtCarrierDutyPct = 33;
+
+bool gRmtTxReady = false;
+uint16_t gRmtCarrierHz = 0;
+
+bool initRmtTx(int pin) {
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX(static_cast<gpio_num_t>(pin), kRmtTxChannel);
+  config.clk_div = kRmtClkDiv;
+  config.tx_config.carrier_en = true;
+  config.tx_config.carrier_freq_hz = 38000;
+  config.tx_config.carrier_duty_percent = kRmtCarrierDutyPct;
+  config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+  config.tx_config.idle_output_en = true;
+  if (rmt_config(&config) != ESP_OK) {
+    return false;
+  }
+  if (rmt_driver_install(kRmtTxChannel, 0, 0) != ESP_OK) {
+    return false;
+  }
+  gRmtCarrierHz = 38000;
+  return true;
+}
+
+void applyRmtCarrier(uint16_t carrierHz) {
+  if (carrierHz == 0 || carrierHz == gRmtCarrierHz) {
+    return;
+  }
+  // Carrier high/low widths are in 80 MHz source-clock ticks.
+  const uint32_t periodTicks = 80000000UL / carrierHz;
+  const uint32_t highTicks = (periodTicks * kRmtCarrierDutyPct) / 100;
+  rmt_set_tx_carrier(kRmtTxChannel, true,
+                     static_cast<uint16_t>(highTicks),
+                     static_cast<uint16_t>(periodTicks - highTicks),
+                     RMT_CARRIER_LEVEL_HIGH);
+  gRmtCarrierHz = carrierHz;
 }
 
+// Converts mark/space durations into RMT items. Durations above the 15-bit
+// item limit are split across consecutive items at the same level.
+void buildRmtItems(const std::vector<uint16_t>& frame, std::vector<rmt_item32_t>& items) {
+  items.clear();
+  items.reserve((frame.size() + 1) / 2 + 2);
+  uint32_t pendingDuration = 0;
+  uint32_t pendingLevel = 0;
+  bool pendingValid = false;
+  auto pushHalf = [&](uint32_t durationUs, uint32_t level) {
+    while (durationUs > 0) {
+      const uint32_t slice = std::min(durationUs, kRmtMaxItemDurationUs);
+      durationUs -= slice;
+      if (!pendingValid) {
+        pendingDuration = slice;
+        pendingLevel = level;
+        pendingValid = true;
+        continue;
+      }
+      rmt_item32_t item;
+      item.duration0 = static_cast<uint16_t>(pendingDuration);
+      item.level0 = pendingLevel;
+      item.duration1 = static_cast<uint16_t>(slice);
+      item.level1 = level;
+      items.push_back(item);
+      pendingValid = false;
+    }
+  };
+  for (size_t i = 0; i < frame.size(); i++) {
+    pushHalf(frame[i], (i % 2 == 0) ? 1 : 0);
+  }
+  if (pendingValid) {
+    rmt_item32_t item;
+    item.duration0 = static_cast<uint16_t>(pendingDuration);
+    item.level0 = pendingLevel;
+    item.duration1 = 0;
+    item.level1 = 0;
+    items.push_back(item);
+  }
+}
+
+bool sendFrameProtocolBitBang(const String& protocol, const String& addressStr, const String& commandStr);
+
+bool sendFrameRawRmt(const std::vector<uint16_t>& frame, uint16_t carrierHz) {
+  applyRmtCarrier(carrierHz);
+  std::vector<rmt_item32_t> items;
+  buildRmtItems(frame, items);
+  if (items.empty()) {
+    return false;
+  }
+  return rmt_write_items(kRmtTxChannel, items.data(), items.size(), true) == ESP_OK;
+}
+
+}  // namespace
+
 bool canSend() {
   return gIrSender != nullptr;
 }
@@ -53,6 +157,10 @@ void initIrHardware() {
   if (isValidPin(gRuntimeConfig.irTxPin)) {
     gIrSender = new IRsend(static_cast<uint16_t>(gRuntimeConfig.irTxPin));
     gIrSender->begin();
+    // Prefer the hardware path for raw frames; initRmtTx takes over the pin
+    // mux, so it must run after IRsend::begin(). Protocol sends keep using
+    // the library encoders, which drive the pin through bit-banging again.
+    gRmtTxReady = initRmtTx(gRuntimeConfig.irTxPin);
   }
   if (isValidPin(gRuntimeConfig.irRxPin)) {
     gIrReceiver = new IRrecv(static_cast<uint16_t>(gRuntimeConfig.irRxPin), 1024, 15, true);
@@ -75,40 +183,61 @@ String buildRawTextFromDecode(const decode_results& result) {
   return raw;
 }
 
-bool parseRawSignal(const String& input, std::vector<uint16_t>& out) {
+bool parseRawSignal(const char* input, std::vector<uint16_t>& out) {
+  return codec::parseRawDurations(input, out);
+}
+
+bool parseBinarySignal(const char* input, std::vector<uint16_t>& out) {
   out.clear();
-  String text = input;
-  text.trim();
-  if (text.isEmpty()) {
+  if (input == nullptr) {
     return false;
   }
-  int start = 0;
-  while (start < text.length()) {
-    while (start < text.length() && text.charAt(start) == ' ') {
-      start++;
-    }
-    if (start >= text.length()) {
-      break;
-    }
-    int end = text.indexOf(' ', start);
-    if (end < 0) {
-      end = text.length();
-    }
-    const String token = text.substring(start, end);
-    char* endPtr = nullptr;
-    const long value = strtol(token.c_str(), &endPtr, 10);
-    if (endPtr == token.c_str() || *endPtr != '\0' || value == 0) {
-      return false;
+  const size_t b64Len = strlen(input);
+  if (b64Len == 0 || (b64Len % 4) != 0) {
+    return false;
+  }
+  const size_t maxDecoded = (b64Len / 4) * 3;
+  std::vector<unsigned char> decoded(maxDecoded);
+  size_t decodedLen = 0;
+  if (mbedtls_base64_decode(decoded.data(), maxDecoded, &decodedLen,
+                            reinterpret_cast<const unsigned char*>(input),
+                            b64Len) != 0) {
+    return false;
+  }
+  return codec::unpackBinaryDurations(decoded.data(), decodedLen, out);
+}
+
+String quantizeRawSignal(const String& raw) {
+  uint32_t tickUs = 0;
+  return quantizeRawSignal(raw, tickUs);
+}
+
+String quantizeRawSignal(const String& raw, uint32_t& tickUs) {
+  std::vector<uint16_t> durations;
+  if (!parseRawSignal(raw.c_str(), durations) || durations.size() < 4) {
+    return raw;
+  }
+
+  if (tickUs == 0) {
+    tickUs = codec::estimateTickUs(durations);
+    if (tickUs == 0) {
+      return raw;
     }
-    if (out.empty() && value < 0) {
-      return false;
+  }
+  codec::quantizeToTick(durations, tickUs);
+
+  // Re-emit as text. Identical frames become byte-identical strings, which
+  // is what makes repeat collapsing in the burst response work.
+  String out;
+  out.reserve(raw.length());
+  for (size_t i = 0; i < durations.size(); i++) {
+    if (i > 0) {
+      out += ' ';
     }
-    const uint32_t absolute = static_cast<uint32_t>(std::abs(value));
-    const uint16_t duration = static_cast<uint16_t>(std::min<uint32_t>(absolute, 65535));
-    out.push_back(duration);
-    start = end + 1;
+    out += (i % 2 == 0) ? '+' : '-';
+    out += String(durations[i]);
   }
-  return !out.empty();
+  return out;
 }
 
 uint32_t frameDurationUs(const std::vector<uint16_t>& frame) {
@@ -119,25 +248,13 @@ uint32_t frameDurationUs(const std::vector<uint16_t>& frame) {
   return total;
 }
 
-void delayUsWithYield(uint32_t durationUs) {
-  if (durationUs == 0) {
-    return;
-  }
-  uint32_t remaining = durationUs;
-  while (remaining > 1000) {
-    delayMicroseconds(1000);
-    remaining -= 1000;
-    yield();
-  }
-  if (remaining > 0) {
-    delayMicroseconds(remaining);
-  }
-}
-
 bool sendFrameRaw(const std::vector<uint16_t>& frame, uint16_t carrierHz) {
   if (!gIrSender || frame.empty()) {
     return false;
   }
+  if (gRmtTxReady && sendFrameRawRmt(frame, carrierHz)) {
+    return true;
+  }
   const uint16_t khz = static_cast<uint16_t>(std::max<uint16_t>(1, carrierHz / 1000));
   gIrSender->sendRaw(frame.data(), static_cast<uint16_t>(frame.size()), khz);
   return true;
@@ -146,34 +263,7 @@ bool sendFrameRaw(const std::vector<uint16_t>& frame, uint16_t carrierHz) {
 // Parse space-separated hex byte tokens (e.g. "20 00") into a byte vector.
 // Returns false if any token is malformed or the result is empty.
 static bool parseHexBytes(const String& input, std::vector<uint8_t>& out) {
-  out.clear();
-  String text = input;
-  text.trim();
-  if (text.isEmpty()) {
-    return false;
-  }
-  int start = 0;
-  while (start < static_cast<int>(text.length())) {
-    while (start < static_cast<int>(text.length()) && text.charAt(start) == ' ') {
-      start++;
-    }
-    if (start >= static_cast<int>(text.length())) {
-      break;
-    }
-    int end = text.indexOf(' ', start);
-    if (end < 0) {
-      end = static_cast<int>(text.length());
-    }
-    const String token = text.substring(start, end);
-    char* endPtr = nullptr;
-    const long val = strtol(token.c_str(), &endPtr, 16);
-    if (endPtr == token.c_str() || *endPtr != '\0') {
-      return false;
-    }
-    out.push_back(static_cast<uint8_t>(val & 0xFF));
-    start = end + 1;
-  }
-  return !out.empty();
+  return codec::parseHexBytes(input.c_str(), out);
 }
 
 bool sendFrameProtocol(const String& protocol, const String& addressStr, const String& commandStr) {
@@ -181,109 +271,186 @@ bool sendFrameProtocol(const String& protocol, const String& addressStr, const S
     return false;
   }
 
-  std::vector<uint8_t> addr;
-  std::vector<uint8_t> cmd;
-  if (!parseHexBytes(addressStr, addr) || !parseHexBytes(commandStr, cmd)) {
-    return false;
+  // Protocol sends go through the library's bit-bang encoders. When the RMT
+  // backend owns the TX pin mux, hand the pin back to plain GPIO for the
+  // duration of the send and re-attach the RMT signal afterwards.
+  if (gRmtTxReady) {
+    pinMode(gRuntimeConfig.irTxPin, OUTPUT);
+    digitalWrite(gRuntimeConfig.irTxPin, LOW);
   }
-  if (addr.empty() || cmd.empty()) {
-    return false;
+  const bool sent = sendFrameProtocolBitBang(protocol, addressStr, commandStr);
+  if (gRmtTxReady) {
+    rmt_set_pin(kRmtTxChannel, RMT_MODE_TX, static_cast<gpio_num_t>(gRuntimeConfig.irTxPin));
   }
+  return sent;
+}
 
-  // Helper to safely index into byte vectors with a fallback.
-  auto b = [](const std::vector<uint8_t>& v, size_t i, uint8_t fallback = 0) -> uint8_t {
-    return i < v.size() ? v[i] : fallback;
-  };
+namespace {
 
-  if (protocol == "NEC") {
-    gIrSender->sendNEC(
-        gIrSender->encodeNEC(static_cast<uint16_t>(b(addr, 0)), static_cast<uint16_t>(b(cmd, 0))),
-        kNECBits);
-    return true;
-  }
+// Safely index into a parsed byte vector with a fallback.
+uint8_t byteAt(const std::vector<uint8_t>& v, size_t i, uint8_t fallback = 0) {
+  return i < v.size() ? v[i] : fallback;
+}
 
-  if (protocol == "NECext") {
-    // 16-bit address: address[0] = high byte, address[1] = low byte (Flipper little-endian byte order).
-    const uint16_t addr16 = static_cast<uint16_t>(b(addr, 0)) |
-                            (static_cast<uint16_t>(b(addr, 1)) << 8);
-    gIrSender->sendNEC(
-        gIrSender->encodeNEC(addr16, static_cast<uint16_t>(b(cmd, 0))),
-        kNECBits);
-    return true;
-  }
+bool sendProtoNec(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  gIrSender->sendNEC(
+      gIrSender->encodeNEC(static_cast<uint16_t>(byteAt(addr, 0)),
+                           static_cast<uint16_t>(byteAt(cmd, 0))),
+      kNECBits);
+  return true;
+}
 
-  if (protocol == "Samsung32") {
-    gIrSender->sendSAMSUNG(
-        gIrSender->encodeSAMSUNG(b(addr, 0), b(cmd, 0)),
-        kSamsungBits);
-    return true;
-  }
+bool sendProtoNecExt(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  // 16-bit address: address[0] = high byte, address[1] = low byte (Flipper little-endian byte order).
+  const uint16_t addr16 = static_cast<uint16_t>(byteAt(addr, 0)) |
+                          (static_cast<uint16_t>(byteAt(addr, 1)) << 8);
+  gIrSender->sendNEC(
+      gIrSender->encodeNEC(addr16, static_cast<uint16_t>(byteAt(cmd, 0))),
+      kNECBits);
+  return true;
+}
 
-  if (protocol == "SIRC") {
-    // Sony 12-bit: 7-bit command, 5-bit address.
-    gIrSender->sendSony(
-        gIrSender->encodeSony(kSony12Bits, b(cmd, 0), b(addr, 0) & 0x1Fu),
-        kSony12Bits,
-        kSonyMinRepeat);
-    return true;
-  }
+bool sendProtoSamsung32(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  gIrSender->sendSAMSUNG(
+      gIrSender->encodeSAMSUNG(byteAt(addr, 0), byteAt(cmd, 0)),
+      kSamsungBits);
+  return true;
+}
 
-  if (protocol == "SIRC15") {
-    // Sony 15-bit: 7-bit command, 8-bit address.
-    gIrSender->sendSony(
-        gIrSender->encodeSony(kSony15Bits, b(cmd, 0), b(addr, 0)),
-        kSony15Bits,
-        kSonyMinRepeat);
-    return true;
-  }
+bool sendProtoSirc(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  // Sony 12-bit: 7-bit command, 5-bit address.
+  gIrSender->sendSony(
+      gIrSender->encodeSony(kSony12Bits, byteAt(cmd, 0), byteAt(addr, 0) & 0x1Fu),
+      kSony12Bits,
+      kSonyMinRepeat);
+  return true;
+}
 
-  if (protocol == "SIRC20") {
-    // Sony 20-bit: 7-bit command, 5-bit device address, 8-bit sub-device.
-    // Flipper stores device in addr[0] (low 5 bits) and sub-device in addr[1].
-    gIrSender->sendSony(
-        gIrSender->encodeSony(kSony20Bits, b(cmd, 0), b(addr, 0) & 0x1Fu, b(addr, 1)),
-        kSony20Bits,
-        kSonyMinRepeat);
-    return true;
-  }
+bool sendProtoSirc15(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  // Sony 15-bit: 7-bit command, 8-bit address.
+  gIrSender->sendSony(
+      gIrSender->encodeSony(kSony15Bits, byteAt(cmd, 0), byteAt(addr, 0)),
+      kSony15Bits,
+      kSonyMinRepeat);
+  return true;
+}
 
-  if (protocol == "RC5") {
-    gIrSender->sendRC5(
-        gIrSender->encodeRC5(b(addr, 0) & 0x1Fu, b(cmd, 0) & 0x3Fu),
-        kRC5Bits);
-    return true;
-  }
+bool sendProtoSirc20(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  // Sony 20-bit: 7-bit command, 5-bit device address, 8-bit sub-device.
+  // Flipper stores device in addr[0] (low 5 bits) and sub-device in addr[1].
+  gIrSender->sendSony(
+      gIrSender->encodeSony(kSony20Bits, byteAt(cmd, 0), byteAt(addr, 0) & 0x1Fu, byteAt(addr, 1)),
+      kSony20Bits,
+      kSonyMinRepeat);
+  return true;
+}
 
-  if (protocol == "RC6") {
-    gIrSender->sendRC6(
-        gIrSender->encodeRC6(static_cast<uint32_t>(b(addr, 0)), b(cmd, 0)),
-        kRC6Mode0Bits);
-    return true;
+bool sendProtoRc5(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  gIrSender->sendRC5(
+      gIrSender->encodeRC5(byteAt(addr, 0) & 0x1Fu, byteAt(cmd, 0) & 0x3Fu),
+      kRC5Bits);
+  return true;
+}
+
+bool sendProtoRc6(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  gIrSender->sendRC6(
+      gIrSender->encodeRC6(static_cast<uint32_t>(byteAt(addr, 0)), byteAt(cmd, 0)),
+      kRC6Mode0Bits);
+  return true;
+}
+
+bool sendProtoKaseikyo(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  // Flipper stores: addr[0..1] = manufacturer code (little-endian),
+  // addr[2] = device, addr[3] = sub-device, cmd[0] = function.
+  const uint16_t manufacturer = static_cast<uint16_t>(byteAt(addr, 0)) |
+                                (static_cast<uint16_t>(byteAt(addr, 1)) << 8);
+  const uint64_t encoded = gIrSender->encodePanasonic(
+      manufacturer, byteAt(addr, 2), byteAt(addr, 3), byteAt(cmd, 0));
+  // sendPanasonic takes the 16-bit OEM code and the 32-bit data word separately.
+  const uint16_t pa_address = static_cast<uint16_t>(encoded >> 32);
+  const uint32_t pa_data = static_cast<uint32_t>(encoded & 0xFFFFFFFFULL);
+  gIrSender->sendPanasonic(pa_address, pa_data);
+  return true;
+}
+
+bool sendProtoJvc(const std::vector<uint8_t>& addr, const std::vector<uint8_t>& cmd) {
+  gIrSender->sendJVC(
+      gIrSender->encodeJVC(byteAt(addr, 0), byteAt(cmd, 0)),
+      kJvcBits,
+      1);
+  return true;
+}
+
+// Protocol registry: one data row per protocol instead of a branch chain.
+// The name hash is computed at compile time; dispatch compares hashes first
+// and confirms with one strcmp, so adding rows cannot regress lookup cost.
+using ProtocolSendFn = bool (*)(const std::vector<uint8_t>& addr,
+                                const std::vector<uint8_t>& cmd);
+
+constexpr uint32_t fnv1aHash(const char* text, uint32_t hash = 2166136261u) {
+  return (*text == '\0')
+             ? hash
+             : fnv1aHash(text + 1,
+                         (hash ^ static_cast<uint32_t>(*text)) * 16777619u);
+}
+
+struct ProtocolDescriptor {
+  const char* name;
+  uint32_t nameHash;
+  ProtocolSendFn send;
+};
+
+constexpr ProtocolDescriptor kProtocolTable[] = {
+    {"NEC", fnv1aHash("NEC"), &sendProtoNec},
+    {"NECext", fnv1aHash("NECext"), &sendProtoNecExt},
+    {"Samsung32", fnv1aHash("Samsung32"), &sendProtoSamsung32},
+    {"SIRC", fnv1aHash("SIRC"), &sendProtoSirc},
+    {"SIRC15", fnv1aHash("SIRC15"), &sendProtoSirc15},
+    {"SIRC20", fnv1aHash("SIRC20"), &sendProtoSirc20},
+    {"RC5", fnv1aHash("RC5"), &sendProtoRc5},
+    {"RC6", fnv1aHash("RC6"), &sendProtoRc6},
+    {"Kaseikyo", fnv1aHash("Kaseikyo"), &sendProtoKaseikyo},
+    {"JVC", fnv1aHash("JVC"), &sendProtoJvc},
+};
+
+constexpr size_t kProtocolTableSize = sizeof(kProtocolTable) / sizeof(kProtocolTable[0]);
+
+const ProtocolDescriptor* findProtocol(const String& name) {
+  const uint32_t hash = fnv1aHash(name.c_str());
+  for (size_t i = 0; i < kProtocolTableSize; i++) {
+    if (kProtocolTable[i].nameHash == hash &&
+        name.equals(kProtocolTable[i].name)) {
+      return &kProtocolTable[i];
+    }
   }
+  return nullptr;
+}
 
-  if (protocol == "Kaseikyo") {
-    // Flipper stores: addr[0..1] = manufacturer code (little-endian),
-    // addr[2] = device, addr[3] = sub-device, cmd[0] = function.
-    const uint16_t manufacturer = static_cast<uint16_t>(b(addr, 0)) |
-                                  (static_cast<uint16_t>(b(addr, 1)) << 8);
-    const uint64_t encoded = gIrSender->encodePanasonic(
-        manufacturer, b(addr, 2), b(addr, 3), b(cmd, 0));
-    // sendPanasonic takes the 16-bit OEM code and the 32-bit data word separately.
-    const uint16_t pa_address = static_cast<uint16_t>(encoded >> 32);
-    const uint32_t pa_data = static_cast<uint32_t>(encoded & 0xFFFFFFFFULL);
-    gIrSender->sendPanasonic(pa_address, pa_data);
-    return true;
+bool sendFrameProtocolBitBang(const String& protocol, const String& addressStr, const String& commandStr) {
+  const ProtocolDescriptor* descriptor = findProtocol(protocol);
+  if (descriptor == nullptr) {
+    return false;  // Protocol not supported by this firmware version.
   }
 
-  if (protocol == "JVC") {
-    gIrSender->sendJVC(
-        gIrSender->encodeJVC(b(addr, 0), b(cmd, 0)),
-        kJvcBits,
-        1);
-    return true;
+  std::vector<uint8_t> addr;
+  std::vector<uint8_t> cmd;
+  if (!parseHexBytes(addressStr, addr) || !parseHexBytes(commandStr, cmd)) {
+    return false;
+  }
+  if (addr.empty() || cmd.empty()) {
+    return false;
   }
+  return descriptor->send(addr, cmd);
+}
+
+}  // namespace
+
+const char* supportedProtocolName(size_t index) {
+  return (index < kProtocolTableSize) ? kProtocolTable[index].name : nullptr;
+}
 
-  return false;  // Protocol not supported by this firmware version.
+size_t supportedProtocolCount() {
+  return kProtocolTableSize;
 }
 
 }  // namespace agent
@@ -14,9 +14,26 @@ void applyLearningReceiverState();
 void initIrHardware();
 
 String buildRawTextFromDecode(const decode_results& result);
-bool parseRawSignal(const String& input, std::vector<uint16_t>& out);
+// Parses alternating sign-prefixed durations ("+560 -1690 ...") by scanning
+// the text in place; the input may alias an MQTT payload buffer.
+bool parseRawSignal(const char* input, std::vector<uint16_t>& out);
+
+// Decode a binary raw frame: base64-wrapped little-endian uint16 durations in
+// microseconds, alternating mark/space starting with a mark. Roughly 4x
+// smaller on the wire than the ASCII "+500 -400" form and decoded without
+// per-token String work. Advertised via the "encodings" list in state/agent.
+bool parseBinarySignal(const char* input, std::vector<uint16_t>& out);
+// Rounds a learned raw signal's durations to the protocol base tick estimated
+// from the shortest-duration cluster, so receiver jitter does not make
+// identical frames differ. Returns the input unchanged when no tick can be
+// estimated (too few edges, or sub-noise-floor durations).
+String quantizeRawSignal(const String& raw);
+// Shared-tick variant for burst captures: pass tickUs = 0 on the first frame
+// to estimate it and write it back, then reuse the value for the remaining
+// frames. Per-frame estimates drift a few µs with jitter, which would make
+// quantized repeats of the same button differ and defeat repeat folding.
+String quantizeRawSignal(const String& raw, uint32_t& tickUs);
 uint32_t frameDurationUs(const std::vector<uint16_t>& frame);
-void delayUsWithYield(uint32_t durationUs);
 bool sendFrameRaw(const std::vector<uint16_t>& frame, uint16_t carrierHz);
 
 // Send a protocol-encoded IR signal (NEC, Samsung32, SIRC, RC5, RC6, Kaseikyo, JVC).
@@ -25,4 +42,11 @@ bool sendFrameRaw(const std::vector<uint16_t>& frame, uint16_t carrierHz);
 // Returns false for unsupported protocols or parse errors.
 bool sendFrameProtocol(const String& protocol, const String& addressStr, const String& commandStr);
 
+// Enumerate the protocol registry so the agent can advertise its encoder
+// capabilities instead of the hub probing with trial sends. Names match the
+// `protocol` field accepted by sendFrameProtocol. supportedProtocolName
+// returns nullptr past the end.
+size_t supportedProtocolCount();
+const char* supportedProtocolName(size_t index);
+
 }  // namespace agent
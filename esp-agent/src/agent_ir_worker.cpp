@@ -0,0 +1,215 @@
+#include "agent_ir_worker.h"
+
+#include "agent_ir.h"
+#include "agent_logs.h"
+#include "agent_state.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cmath>
+
+namespace agent {
+
+namespace {
+
+constexpr UBaseType_t kIrJobQueueDepth = 8;
+constexpr UBaseType_t kIrResultQueueDepth = 8;
+constexpr uint32_t kIrWorkerStackWords = 4096;
+constexpr UBaseType_t kIrWorkerPriority = 2;
+constexpr BaseType_t kIrWorkerCore = 1;
+
+QueueHandle_t gIrJobQueue = nullptr;
+QueueHandle_t gIrResultQueue = nullptr;
+
+// Results dropped because gIrResultQueue was full. Core 0 folds this into
+// its in-flight accounting; without it every drop would leak a slot in
+// pendingWorkDepth() and eventually wedge admission control.
+std::atomic<uint32_t> gDroppedResultCount{0};
+
+// Blocks the worker until the absolute esp_timer deadline without burning
+// CPU: the bulk of the wait is a real vTaskDelay (the core can idle or run
+// other tasks), only the last sub-millisecond remainder is spun for accuracy.
+void sleepUntilUs(int64_t deadlineUs) {
+  for (;;) {
+    const int64_t remainingUs = deadlineUs - esp_timer_get_time();
+    if (remainingUs <= 0) {
+      return;
+    }
+    if (remainingUs > 2000) {
+      vTaskDelay(pdMS_TO_TICKS(static_cast<uint32_t>((remainingUs - 1000) / 1000)));
+      continue;
+    }
+    delayMicroseconds(static_cast<uint32_t>(remainingUs));
+    return;
+  }
+}
+
+void failResult(IrJobResult& result, const String& errorCode, const String& errorMessage, int statusCode) {
+  result.ok = false;
+  result.errorCode = errorCode;
+  result.errorMessage = errorMessage;
+  result.statusCode = statusCode;
+}
+
+void executeSendJob(const IrSendJob& job, IrJobResult& result) {
+  result.hubId = job.hubId;
+  result.requestId = job.requestId;
+  result.command = (job.kind == IrJobKind::SendSequence) ? "send/sequence" : "send";
+
+  if (job.kind == IrJobKind::SendProtocol) {
+    if (!sendFrameProtocol(job.protocolName, job.addressStr, job.commandStr)) {
+      failResult(result, "runtime_error", String("Unsupported or invalid IR protocol: ") + job.protocolName, 409);
+      return;
+    }
+    result.ok = true;
+    result.mode = "press";
+    result.repeats = 0;
+    result.hasGap = false;
+    return;
+  }
+
+  if (job.kind == IrJobKind::SendSequence) {
+    // Whole scene in one job: inter-step gaps are paced against absolute
+    // deadlines, so step spacing is deterministic instead of jittering with
+    // broker round-trips.
+    int64_t nextStepAtUs = esp_timer_get_time();
+    for (size_t i = 0; i < job.steps.size(); i++) {
+      const IrSequenceStep& step = job.steps[i];
+      sleepUntilUs(nextStepAtUs);
+      const bool sent = step.isProtocol
+                            ? sendFrameProtocol(step.protocolName, step.addressStr, step.commandStr)
+                            : sendFrameRaw(step.frame, step.carrierHz);
+      if (!sent) {
+        failResult(result, "runtime_error",
+                   String("Failed to send sequence step ") + String(i), 409);
+        return;
+      }
+      nextStepAtUs = esp_timer_get_time() + step.gapUs;
+    }
+    result.ok = true;
+    result.mode = "sequence";
+    result.repeats = static_cast<uint32_t>(job.steps.size());
+    result.hasGap = false;
+    return;
+  }
+
+  if (job.kind == IrJobKind::SendPress) {
+    if (!sendFrameRaw(job.pressFrame, job.carrierHz)) {
+      failResult(result, "runtime_error", "Failed to send press frame", 409);
+      return;
+    }
+    result.ok = true;
+    result.mode = "press";
+    result.repeats = 0;
+    result.hasGap = false;
+    return;
+  }
+
+  // SendHold — initial frame, then gap-spaced repeats until hold_ms is covered.
+  if (!sendFrameRaw(job.holdInitialFrame, job.carrierHz)) {
+    failResult(result, "runtime_error", "Failed to send hold initial frame", 409);
+    return;
+  }
+
+  const uint32_t targetUs = static_cast<uint32_t>(job.holdMs) * 1000UL;
+  const uint32_t initialUs = frameDurationUs(job.holdInitialFrame);
+  const uint32_t repeatUs = frameDurationUs(job.holdRepeatFrame);
+  const uint32_t periodUs = repeatUs + static_cast<uint32_t>(job.holdGapUs);
+  const uint32_t remainingUs = (targetUs > initialUs) ? (targetUs - initialUs) : 0;
+  uint32_t repeatCount = 1;
+  if (periodUs > 0 && remainingUs > 0) {
+    repeatCount = static_cast<uint32_t>(std::ceil(
+        static_cast<float>(remainingUs) / static_cast<float>(periodUs)));
+    if (repeatCount == 0) {
+      repeatCount = 1;
+    }
+  }
+
+  // Pace repeats against absolute deadlines so emission time does not drift
+  // the gap, and the gap itself is slept rather than busy-waited.
+  int64_t nextFrameAtUs = esp_timer_get_time() + job.holdGapUs;
+  for (uint32_t i = 0; i < repeatCount; i++) {
+    sleepUntilUs(nextFrameAtUs);
+    if (!sendFrameRaw(job.holdRepeatFrame, job.carrierHz)) {
+      failResult(result, "runtime_error", "Failed to send hold repeat frame", 409);
+      return;
+    }
+    nextFrameAtUs = esp_timer_get_time() + job.holdGapUs;
+  }
+
+  result.ok = true;
+  result.mode = "hold";
+  result.holdMs = job.holdMs;
+  result.gapUs = job.holdGapUs;
+  result.hasGap = true;
+  result.repeats = repeatCount;
+}
+
+void irWorkerTask(void* /*arg*/) {
+  for (;;) {
+    IrSendJob* job = nullptr;
+    if (xQueueReceive(gIrJobQueue, &job, portMAX_DELAY) != pdTRUE || job == nullptr) {
+      continue;
+    }
+    IrJobResult* result = new IrJobResult();
+    executeSendJob(*job, *result);
+    delete job;
+    if (xQueueSend(gIrResultQueue, &result, pdMS_TO_TICKS(100)) != pdTRUE) {
+      // Result queue is full — drop the result rather than block IR emission;
+      // the hub times out the request and retries. The drop is counted so
+      // core 0 can still retire the job from its in-flight bookkeeping.
+      gDroppedResultCount.fetch_add(1, std::memory_order_relaxed);
+      delete result;
+    }
+  }
+}
+
+}  // namespace
+
+void initIrWorker() {
+  if (gIrJobQueue != nullptr) {
+    return;
+  }
+  gIrJobQueue = xQueueCreate(kIrJobQueueDepth, sizeof(IrSendJob*));
+  gIrResultQueue = xQueueCreate(kIrResultQueueDepth, sizeof(IrJobResult*));
+  if (!gIrJobQueue || !gIrResultQueue) {
+    logError("system", "Failed to allocate IR worker queues", "ir_worker_init_failed");
+    return;
+  }
+  xTaskCreatePinnedToCore(
+      irWorkerTask,
+      "ir_worker",
+      kIrWorkerStackWords,
+      nullptr,
+      kIrWorkerPriority,
+      nullptr,
+      kIrWorkerCore);
+}
+
+bool irWorkerEnqueueSend(IrSendJob* job) {
+  if (!gIrJobQueue || job == nullptr) {
+    return false;
+  }
+  return xQueueSend(gIrJobQueue, &job, 0) == pdTRUE;
+}
+
+uint32_t irWorkerTakeDroppedResultCount() {
+  return gDroppedResultCount.exchange(0, std::memory_order_relaxed);
+}
+
+IrJobResult* irWorkerTakeResult() {
+  if (!gIrResultQueue) {
+    return nullptr;
+  }
+  IrJobResult* result = nullptr;
+  if (xQueueReceive(gIrResultQueue, &result, 0) != pdTRUE) {
+    return nullptr;
+  }
+  return result;
+}
+
+}  // namespace agent
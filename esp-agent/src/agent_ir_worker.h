@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+namespace agent {
+
+// The IR worker task owns gIrSender and executes send jobs on core 1, so
+// long hold-mode emissions never stall the MQTT loop on core 0. gIrReceiver
+// stays with core 0, which polls it from processPendingLearnCapture().
+// Jobs are enqueued from the command layer; completion results are drained
+// from processBackgroundTasks() and turned into command responses there —
+// PubSubClient is not thread-safe, so only core 0 ever touches gMqttClient.
+
+enum class IrJobKind : uint8_t {
+  SendPress,
+  SendHold,
+  SendProtocol,
+  SendSequence,
+};
+
+// One step of a send/sequence macro: a resolved frame (raw or protocol) plus
+// the gap to wait before the next step fires.
+struct IrSequenceStep {
+  bool isProtocol = false;
+  std::vector<uint16_t> frame;  // raw steps
+  uint16_t carrierHz = 38000;
+  String protocolName;          // protocol steps
+  String addressStr;
+  String commandStr;
+  uint32_t gapUs = 0;
+};
+
+struct IrSendJob {
+  IrJobKind kind = IrJobKind::SendPress;
+  String hubId;
+  String requestId;
+  uint16_t carrierHz = 38000;
+  std::vector<uint16_t> pressFrame;        // SendPress
+  std::vector<uint16_t> holdInitialFrame;  // SendHold
+  std::vector<uint16_t> holdRepeatFrame;   // SendHold
+  int holdMs = 0;                          // SendHold
+  int holdGapUs = 0;                       // SendHold
+  String protocolName;                     // SendProtocol
+  String addressStr;                       // SendProtocol
+  String commandStr;                       // SendProtocol
+  std::vector<IrSequenceStep> steps;       // SendSequence
+};
+
+struct IrJobResult {
+  String hubId;
+  String requestId;
+  String command;  // Originating command name ("send" or "send/sequence").
+  bool ok = false;
+  String errorCode;
+  String errorMessage;
+  int statusCode = 500;
+  String mode;
+  int holdMs = 0;
+  int gapUs = 0;
+  bool hasGap = false;
+  uint32_t repeats = 0;
+};
+
+void initIrWorker();
+
+// Takes ownership of the job on success. Returns false (ownership retained by
+// the caller) when the job queue is full.
+bool irWorkerEnqueueSend(IrSendJob* job);
+
+// Returns the next completed job result, or nullptr if none is pending.
+// The caller owns the returned object and must delete it.
+IrJobResult* irWorkerTakeResult();
+
+// Returns the number of results dropped because the result queue was full
+// and resets the counter. Core 0 drains this alongside irWorkerTakeResult()
+// so its in-flight job accounting stays reconciled with dropped results.
+uint32_t irWorkerTakeDroppedResultCount();
+
+}  // namespace agent
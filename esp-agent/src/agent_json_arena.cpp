@@ -0,0 +1,120 @@
+#include "agent_json_arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace agent {
+
+namespace {
+
+// Sized for kMqttBufferSize-class command payloads plus the response document
+// built alongside them. Anything larger spills to the heap per allocation.
+constexpr size_t kJsonArenaBytes = 24576;
+// Every block is prefixed by one aligned header word holding its payload
+// size, so reallocate can copy the old contents and the most recent block
+// can grow in place (ArduinoJson grows its string pool that way).
+constexpr size_t kJsonArenaAlign = 8;
+
+alignas(kJsonArenaAlign) uint8_t gArenaBuffer[kJsonArenaBytes];
+size_t gArenaOffset = 0;
+size_t gArenaHighWater = 0;
+uint32_t gHeapFallbacks = 0;
+uint8_t* gLastPayload = nullptr;
+
+bool inArena(const void* ptr) {
+  return ptr >= gArenaBuffer && ptr < gArenaBuffer + kJsonArenaBytes;
+}
+
+size_t alignUp(size_t value) {
+  return (value + kJsonArenaAlign - 1) & ~(kJsonArenaAlign - 1);
+}
+
+size_t& blockSize(uint8_t* payload) {
+  return *reinterpret_cast<size_t*>(payload - kJsonArenaAlign);
+}
+
+class ArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override {
+    const size_t needed = alignUp(kJsonArenaAlign + size);
+    if (gArenaOffset + needed <= kJsonArenaBytes) {
+      uint8_t* payload = gArenaBuffer + gArenaOffset + kJsonArenaAlign;
+      blockSize(payload) = size;
+      gArenaOffset += needed;
+      if (gArenaOffset > gArenaHighWater) {
+        gArenaHighWater = gArenaOffset;
+      }
+      gLastPayload = payload;
+      return payload;
+    }
+    gHeapFallbacks++;
+    return malloc(size);
+  }
+
+  void deallocate(void* ptr) override {
+    if (ptr == nullptr || inArena(ptr)) {
+      return;  // Arena memory is reclaimed wholesale by jsonArenaReset().
+    }
+    free(ptr);
+  }
+
+  void* reallocate(void* ptr, size_t newSize) override {
+    if (ptr == nullptr) {
+      return allocate(newSize);
+    }
+    if (!inArena(ptr)) {
+      return realloc(ptr, newSize);
+    }
+    uint8_t* payload = static_cast<uint8_t*>(ptr);
+    const size_t oldSize = blockSize(payload);
+    if (newSize <= oldSize) {
+      return ptr;  // Shrink in place; the slack is reclaimed at reset.
+    }
+    if (payload == gLastPayload) {
+      // The top block can simply extend the bump pointer.
+      const size_t blockStart =
+          static_cast<size_t>((payload - kJsonArenaAlign) - gArenaBuffer);
+      const size_t needed = alignUp(kJsonArenaAlign + newSize);
+      if (blockStart + needed <= kJsonArenaBytes) {
+        blockSize(payload) = newSize;
+        gArenaOffset = blockStart + needed;
+        if (gArenaOffset > gArenaHighWater) {
+          gArenaHighWater = gArenaOffset;
+        }
+        return ptr;
+      }
+    }
+    void* fresh = allocate(newSize);
+    if (fresh != nullptr) {
+      memcpy(fresh, ptr, oldSize);
+    }
+    return fresh;
+  }
+};
+
+ArenaAllocator gArenaAllocator;
+
+}  // namespace
+
+ArduinoJson::Allocator* jsonArena() {
+  return &gArenaAllocator;
+}
+
+void jsonArenaReset() {
+  gArenaOffset = 0;
+  gLastPayload = nullptr;
+}
+
+size_t jsonArenaCapacity() {
+  return kJsonArenaBytes;
+}
+
+size_t jsonArenaHighWater() {
+  return gArenaHighWater;
+}
+
+uint32_t jsonArenaHeapFallbacks() {
+  return gHeapFallbacks;
+}
+
+}  // namespace agent
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <ArduinoJson.h>
+
+namespace agent {
+
+// Fixed preallocated bump arena backing the per-message JsonDocuments in the
+// MQTT receive path, the command layer and the state publisher. Individual
+// deallocations inside the arena are no-ops; the whole arena is reclaimed by
+// jsonArenaReset() at a message boundary. Allocations that do not fit fall
+// back to the heap transparently, so oversized payloads still work — they
+// just lose the no-fragmentation guarantee and are counted for diagnostics.
+//
+// jsonArenaReset() must only be called when no arena-backed JsonDocument is
+// alive: at onMqttMessage entry and before each queued command is executed.
+ArduinoJson::Allocator* jsonArena();
+void jsonArenaReset();
+
+// Diagnostics: arena capacity, the largest offset ever reached and how many
+// allocations had to fall back to the heap since boot.
+size_t jsonArenaCapacity();
+size_t jsonArenaHighWater();
+uint32_t jsonArenaHeapFallbacks();
+
+}  // namespace agent
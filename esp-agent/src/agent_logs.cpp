@@ -3,25 +3,60 @@
 #include "agent_runtime_state.h"
 #include "agent_state.h"
 
+#include <cstring>
 #include <esp_system.h>
 
 namespace agent {
 
 namespace {
 
-constexpr size_t kQueuedLogCapacity = 16;
+// Logs are batched into a single JSON-array publish instead of one message
+// per line, and the queue is sized from the heap at first use — a reconnect
+// storm keeps far more history, and debug tracing no longer floods the broker
+// with tiny publishes.
+constexpr size_t kLogBatchMaxEvents = 8;
+constexpr unsigned long kLogFlushIntervalMs = 250;
+constexpr size_t kLogQueueMinCapacity = 16;
+constexpr size_t kLogQueueMaxCapacity = 64;
 
+// Compact fixed-size record — four heap Strings per event fragmented the
+// heap and made the old 16-entry ring all we could afford.
 struct QueuedLogEvent {
   float ts = 0.0f;
-  String level;
-  String category;
-  String message;
-  String errorCode;
+  char level[8];
+  char category[41];
+  char message[181];
+  char errorCode[81];
 };
 
-QueuedLogEvent gQueuedLogs[kQueuedLogCapacity];
+QueuedLogEvent* gQueuedLogs = nullptr;
+size_t gQueuedLogCapacity = 0;
 size_t gQueuedHead = 0;
 size_t gQueuedCount = 0;
+unsigned long gLastLogFlushAtMs = 0;
+
+void ensureLogQueue() {
+  if (gQueuedLogs != nullptr) {
+    return;
+  }
+  // Spend at most 1/8 of the currently free heap on log history.
+  const size_t budget = ESP.getFreeHeap() / 8;
+  size_t capacity = budget / sizeof(QueuedLogEvent);
+  if (capacity < kLogQueueMinCapacity) {
+    capacity = kLogQueueMinCapacity;
+  }
+  if (capacity > kLogQueueMaxCapacity) {
+    capacity = kLogQueueMaxCapacity;
+  }
+  gQueuedLogs = new QueuedLogEvent[capacity];
+  gQueuedLogCapacity = capacity;
+}
+
+void copyBounded(char* destination, size_t destinationSize, const String& source) {
+  const size_t length = (source.length() < destinationSize - 1U) ? source.length() : destinationSize - 1U;
+  memcpy(destination, source.c_str(), length);
+  destination[length] = '\0';
+}
 
 String normalizeLevel(const String& value) {
   String level = value;
@@ -46,51 +81,52 @@ String normalizeText(const String& value, size_t maxLength) {
 }
 
 void enqueueLog(const QueuedLogEvent& event) {
-  if (gQueuedCount < kQueuedLogCapacity) {
-    const size_t index = (gQueuedHead + gQueuedCount) % kQueuedLogCapacity;
+  ensureLogQueue();
+  if (gQueuedCount < gQueuedLogCapacity) {
+    const size_t index = (gQueuedHead + gQueuedCount) % gQueuedLogCapacity;
     gQueuedLogs[index] = event;
     gQueuedCount++;
     return;
   }
   gQueuedLogs[gQueuedHead] = event;
-  gQueuedHead = (gQueuedHead + 1U) % kQueuedLogCapacity;
+  gQueuedHead = (gQueuedHead + 1U) % gQueuedLogCapacity;
 }
 
-bool publishLogEvent(const QueuedLogEvent& event) {
-  JsonDocument doc;
-  doc["ts"] = event.ts;
-  doc["level"] = event.level;
-  doc["category"] = event.category;
-  doc["message"] = event.message;
-  if (event.errorCode.length() > 0U) {
-    doc["error_code"] = event.errorCode;
+void appendLogEvent(JsonArray events, const QueuedLogEvent& event) {
+  JsonObject entry = events.add<JsonObject>();
+  entry["ts"] = event.ts;
+  entry["level"] = event.level;
+  entry["category"] = event.category;
+  entry["message"] = event.message;
+  if (event.errorCode[0] != '\0') {
+    entry["error_code"] = event.errorCode;
   }
-  return mqttPublishJson(topicLogs(), doc, false);
 }
 
 void emitLogEvent(const String& level, const String& category, const String& message, const String& errorCode) {
   QueuedLogEvent event;
   event.ts = static_cast<float>(millis()) / 1000.0f;
-  event.level = normalizeLevel(level);
-  event.category = normalizeText(category, 40);
-  if (event.category.isEmpty()) {
-    event.category = "runtime";
+  copyBounded(event.level, sizeof(event.level), normalizeLevel(level));
+  String normalizedCategory = normalizeText(category, 40);
+  if (normalizedCategory.isEmpty()) {
+    normalizedCategory = "runtime";
   }
-  event.message = normalizeText(message, 180);
-  if (event.message.isEmpty()) {
+  copyBounded(event.category, sizeof(event.category), normalizedCategory);
+  const String normalizedMessage = normalizeText(message, 180);
+  if (normalizedMessage.isEmpty()) {
     return;
   }
-  event.errorCode = normalizeText(errorCode, 80);
+  copyBounded(event.message, sizeof(event.message), normalizedMessage);
+  copyBounded(event.errorCode, sizeof(event.errorCode), normalizeText(errorCode, 80));
 
   Serial.printf(
       "[agent][%s][%s] %s\n",
-      event.level.c_str(),
-      event.category.c_str(),
-      event.message.c_str());
+      event.level,
+      event.category,
+      event.message);
 
-  if (!gMqttClient.connected() || !publishLogEvent(event)) {
-    enqueueLog(event);
-  }
+  enqueueLog(event);
+  flushQueuedLogs();
 }
 
 String resetReasonText(esp_reset_reason_t reason) {
@@ -178,18 +214,32 @@ void logDebug(const String& category, const String& message, const String& error
   emitLogEvent("debug", category, message, errorCode);
 }
 
+// Publishes queued events as JSON-array batches. Flushes when a full batch
+// is waiting or the flush interval has elapsed; failed publishes keep their
+// events queued for the next attempt.
 void flushQueuedLogs() {
-  if (!gMqttClient.connected()) {
+  if (!gMqttClient.connected() || gQueuedCount == 0U) {
+    return;
+  }
+  const bool batchReady = gQueuedCount >= kLogBatchMaxEvents;
+  const bool intervalDue = (millis() - gLastLogFlushAtMs) >= kLogFlushIntervalMs;
+  if (!batchReady && !intervalDue) {
     return;
   }
   while (gQueuedCount > 0U) {
-    const QueuedLogEvent event = gQueuedLogs[gQueuedHead];
-    if (!publishLogEvent(event)) {
+    JsonDocument doc;
+    JsonArray events = doc.to<JsonArray>();
+    const size_t batchSize = (gQueuedCount < kLogBatchMaxEvents) ? gQueuedCount : kLogBatchMaxEvents;
+    for (size_t i = 0; i < batchSize; i++) {
+      appendLogEvent(events, gQueuedLogs[(gQueuedHead + i) % gQueuedLogCapacity]);
+    }
+    if (!mqttPublishJson(topicLogs(), doc, false)) {
       return;
     }
-    gQueuedHead = (gQueuedHead + 1U) % kQueuedLogCapacity;
-    gQueuedCount--;
+    gQueuedHead = (gQueuedHead + batchSize) % gQueuedLogCapacity;
+    gQueuedCount -= batchSize;
   }
+  gLastLogFlushAtMs = millis();
 }
 
 void logBootSummary() {
@@ -0,0 +1,166 @@
+#include "agent_metrics.h"
+
+#include <esp_timer.h>
+
+namespace agent {
+
+namespace {
+
+// Bucket upper bounds in microseconds; the last bucket is open-ended. The
+// spacing is roughly logarithmic — enough resolution to separate "fast",
+// "queued behind something" and "stalled" without per-sample storage.
+constexpr size_t kLatencyBucketCount = 10;
+constexpr uint32_t kLatencyBucketBoundsUs[kLatencyBucketCount - 1] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000};
+
+struct LatencyHistogram {
+  uint32_t counts[kLatencyBucketCount] = {0};
+  uint32_t total = 0;
+  uint32_t maxUs = 0;
+
+  void record(uint32_t us) {
+    size_t bucket = kLatencyBucketCount - 1;
+    for (size_t i = 0; i < kLatencyBucketCount - 1; i++) {
+      if (us < kLatencyBucketBoundsUs[i]) {
+        bucket = i;
+        break;
+      }
+    }
+    counts[bucket]++;
+    total++;
+    if (us > maxUs) {
+      maxUs = us;
+    }
+  }
+
+  // Returns the upper bound of the bucket where the cumulative count crosses
+  // the percentile — coarse by design; the buckets are the resolution.
+  uint32_t percentileUs(uint8_t pct) const {
+    if (total == 0) {
+      return 0;
+    }
+    const uint32_t threshold = static_cast<uint32_t>(
+        (static_cast<uint64_t>(total) * pct + 99) / 100);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < kLatencyBucketCount - 1; i++) {
+      cumulative += counts[i];
+      if (cumulative >= threshold) {
+        return kLatencyBucketBoundsUs[i];
+      }
+    }
+    return maxUs;
+  }
+};
+
+// Per-command-type counters. The slot table is first-come fixed-size; the
+// command vocabulary is small and stable, overflow lands in "other".
+constexpr size_t kCommandSlotCount = 12;
+
+struct CommandSlot {
+  String name;
+  uint32_t count = 0;
+  uint32_t maxUs = 0;
+};
+
+LatencyHistogram gRespondHistogram;    // receive -> response published
+LatencyHistogram gQueueWaitHistogram;  // receive -> execution start
+CommandSlot gCommandSlots[kCommandSlotCount];
+CommandSlot gCommandOverflowSlot;
+
+uint32_t gMqttReconnects = 0;
+int64_t gLastLoopUs = 0;
+uint32_t gLoopMaxGapUs = 0;  // Reset every diagnostics publish.
+
+CommandSlot& slotFor(const String& command) {
+  for (size_t i = 0; i < kCommandSlotCount; i++) {
+    if (gCommandSlots[i].name == command) {
+      return gCommandSlots[i];
+    }
+    if (gCommandSlots[i].name.isEmpty()) {
+      gCommandSlots[i].name = command;
+      return gCommandSlots[i];
+    }
+  }
+  return gCommandOverflowSlot;
+}
+
+void appendHistogram(JsonObject parent, const char* key,
+                     const LatencyHistogram& histogram) {
+  JsonObject out = parent[key].to<JsonObject>();
+  out["count"] = histogram.total;
+  out["p50_us"] = histogram.percentileUs(50);
+  out["p95_us"] = histogram.percentileUs(95);
+  out["max_us"] = histogram.maxUs;
+}
+
+}  // namespace
+
+void metricsNoteLoopIteration() {
+  const int64_t nowUs = esp_timer_get_time();
+  if (gLastLoopUs != 0) {
+    const int64_t gapUs = nowUs - gLastLoopUs;
+    if (gapUs > 0 && static_cast<uint32_t>(gapUs) > gLoopMaxGapUs) {
+      gLoopMaxGapUs = static_cast<uint32_t>(gapUs);
+    }
+  }
+  gLastLoopUs = nowUs;
+}
+
+void metricsNoteLoopSleepStarting() {
+  // Same accounting as a loop-top sample: close out the body that just ran.
+  metricsNoteLoopIteration();
+}
+
+void metricsNoteLoopSleepEnded() {
+  gLastLoopUs = esp_timer_get_time();
+}
+
+void metricsNoteMqttReconnect() {
+  gMqttReconnects++;
+}
+
+void metricsRecordCommand(const String& command, int64_t receivedUs,
+                          int64_t execStartUs, int64_t respondedUs) {
+  if (receivedUs <= 0 || execStartUs < receivedUs || respondedUs < execStartUs) {
+    return;
+  }
+  gQueueWaitHistogram.record(static_cast<uint32_t>(execStartUs - receivedUs));
+  const uint32_t respondUs = static_cast<uint32_t>(respondedUs - receivedUs);
+  gRespondHistogram.record(respondUs);
+
+  CommandSlot& slot = slotFor(command);
+  if (&slot == &gCommandOverflowSlot && slot.name.isEmpty()) {
+    slot.name = "other";
+  }
+  slot.count++;
+  if (respondUs > slot.maxUs) {
+    slot.maxUs = respondUs;
+  }
+}
+
+void metricsFillDiagnostics(JsonObject diagnostics) {
+  JsonObject latency = diagnostics["latency"].to<JsonObject>();
+  appendHistogram(latency, "respond", gRespondHistogram);
+  appendHistogram(latency, "queue_wait", gQueueWaitHistogram);
+
+  JsonObject commands = latency["commands"].to<JsonObject>();
+  for (size_t i = 0; i < kCommandSlotCount; i++) {
+    if (gCommandSlots[i].name.isEmpty()) {
+      break;
+    }
+    JsonObject entry = commands[gCommandSlots[i].name].to<JsonObject>();
+    entry["count"] = gCommandSlots[i].count;
+    entry["max_us"] = gCommandSlots[i].maxUs;
+  }
+  if (gCommandOverflowSlot.count > 0) {
+    JsonObject entry = commands["other"].to<JsonObject>();
+    entry["count"] = gCommandOverflowSlot.count;
+    entry["max_us"] = gCommandOverflowSlot.maxUs;
+  }
+
+  diagnostics["loop_max_gap_us"] = gLoopMaxGapUs;
+  gLoopMaxGapUs = 0;
+  diagnostics["mqtt_reconnects"] = gMqttReconnects;
+}
+
+}  // namespace agent
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <ArduinoJson.h>
+
+namespace agent {
+
+// Lightweight hot-path latency metrics. Everything here is fixed-size and
+// allocation-free: command latencies go into coarse fixed-bucket histograms
+// (good enough for fleet-wide p50/p95 dashboards), loop stalls and MQTT
+// reconnects are plain counters. The aggregate is published with the
+// non-retained state/diagnostics subtopic.
+
+// Call once per loop() iteration; tracks the longest gap between iterations.
+void metricsNoteLoopIteration();
+
+// Call immediately before the intentional idle wait; records the time spent
+// in the loop body so far as a gap sample. Without this, a long stall inside
+// the body would be swallowed by metricsNoteLoopSleepEnded's reset.
+void metricsNoteLoopSleepStarting();
+
+// Call after an intentional idle wait so the blocked time is not counted as
+// a loop stall — the gap metric should only flag unplanned blocking.
+void metricsNoteLoopSleepEnded();
+
+// Call on every successful MQTT (re)connect.
+void metricsNoteMqttReconnect();
+
+// Records one handled command. receivedUs is the esp_timer timestamp taken
+// when the command arrived in the MQTT callback, execStartUs when handleCommand
+// started executing it, respondedUs when the response publish finished (or the
+// job was handed to the IR worker, for deferred commands). Pass receivedUs = 0
+// when the arrival timestamp is unknown; the sample is then dropped.
+void metricsRecordCommand(const String& command, int64_t receivedUs,
+                          int64_t execStartUs, int64_t respondedUs);
+
+// Writes the aggregated metrics into the diagnostics payload and resets the
+// per-window values (loop max gap).
+void metricsFillDiagnostics(JsonObject diagnostics);
+
+}  // namespace agent
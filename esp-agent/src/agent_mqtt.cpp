@@ -2,13 +2,17 @@
 
 #include "agent_commands.h"
 #include "agent_ir.h"
+#include "agent_json_arena.h"
 #include "agent_logs.h"
+#include "agent_metrics.h"
 #include "agent_pairing.h"
 #include "agent_runtime_state.h"
 #include "agent_state.h"
 
 #include <algorithm>
+#include <cstring>
 #include <mbedtls/base64.h>
+#include <vector>
 
 namespace agent {
 
@@ -19,77 +23,168 @@ bool gRetainedHubStateReceived = false;
 bool gRetainedRuntimeStateReceived = false;
 constexpr unsigned long kRetainedStateTimeoutMs = 1200;
 
-struct PendingTransfer {
+// A chunked transfer in flight. Slots form a small fixed pool so the hub can
+// interleave transfers (e.g. a retry of a big AC send while the first is
+// still arriving) without one silently discarding the other.
+struct TransferSlot {
   bool active = false;
   String transferId;
   String command;
   uint8_t chunkCount = 0;
-  uint8_t receivedCount = 0;
-  std::vector<String> chunks;
+  uint8_t nextChunkIndex = 0;
+  unsigned long lastChunkAtMs = 0;
+  std::vector<unsigned char> decoded;
 };
 
-PendingTransfer gPendingTransfer;
+constexpr size_t kTransferSlotCount = 3;
+// A transfer whose next chunk has not arrived within this window is broken;
+// the hub streams chunks back to back, so seconds of silence means it gave up.
+constexpr unsigned long kTransferChunkTimeoutMs = 10000;
+// Slot buffers are reused across transfers up to this capacity (one decoded
+// chunk fits), so steady-state chunked traffic does not churn the heap.
+// Anything larger is released when the transfer ends.
+constexpr size_t kTransferSlotRetainBytes = 12288;
 
-// Accumulates a chunk and, when all chunks are received, reassembles and dispatches the command.
-void handleCommandChunk(const String& command, JsonObjectConst payload) {
+TransferSlot gTransferSlots[kTransferSlotCount];
+
+void resetTransferSlot(TransferSlot& slot) {
+  slot.active = false;
+  slot.transferId = "";
+  slot.command = "";
+  slot.chunkCount = 0;
+  slot.nextChunkIndex = 0;
+  slot.lastChunkAtMs = 0;
+  if (slot.decoded.capacity() > kTransferSlotRetainBytes) {
+    std::vector<unsigned char>().swap(slot.decoded);
+  } else {
+    slot.decoded.clear();
+  }
+}
+
+// Tell the hub a chunked transfer died instead of letting it wait out the
+// response timeout. The transfer_id doubles as the request correlator since
+// the assembled payload (and its request_id) never materialized.
+void publishTransferAbort(const String& transferId, const String& reason, int statusCode) {
+  if (!gMqttClient.connected() || gPairingHubId.isEmpty()) {
+    return;
+  }
+  JsonDocument doc(jsonArena());
+  doc["request_id"] = transferId;
+  doc["ok"] = false;
+  JsonObject errorObject = doc["error"].to<JsonObject>();
+  errorObject["code"] = "transfer_aborted";
+  errorObject["message"] = reason;
+  errorObject["status_code"] = statusCode;
+
+  const String responseTopic = topicResponse(gPairingHubId, transferId);
+  if (!gMqttClient.beginPublish(responseTopic.c_str(), measureJson(doc), false)) {
+    return;
+  }
+  serializeJson(doc, gMqttClient);
+  gMqttClient.endPublish();
+}
+
+// Accumulates chunks and dispatches the command once the last one arrives.
+// Each chunk is base64-decoded on arrival straight into one growing buffer
+// (chunk boundaries are multiples of 4 base64 chars, so per-chunk decode is
+// valid) — the payload is never held as base64 text and decoded bytes at the
+// same time, which matters for multi-KB transfers on a tight heap.
+void handleCommandChunk(const char* command, JsonObjectConst payload) {
   const String transferId = String(payload["transfer_id"] | "");
   const int rawIndex = payload["chunk_index"] | -1;
   const int rawCount = payload["chunk_count"] | 0;
-  const String chunkData = String(payload["chunk_data"] | "");
+  const char* chunkData = payload["chunk_data"] | "";
+  const size_t chunkLen = strlen(chunkData);
 
-  if (transferId.isEmpty() || rawIndex < 0 || rawCount <= 0 || rawCount > 255 || chunkData.isEmpty()) {
+  if (transferId.isEmpty() || rawIndex < 0 || rawCount <= 0 || rawCount > 255 || chunkLen == 0
+      || (chunkLen % 4) != 0) {
     return;
   }
   const uint8_t chunkCount = static_cast<uint8_t>(rawCount);
   const uint8_t chunkIndex = static_cast<uint8_t>(rawIndex);
 
-  // Start a new transfer or discard a stale one if the transfer_id changed.
-  if (!gPendingTransfer.active || gPendingTransfer.transferId != transferId) {
-    gPendingTransfer.active = true;
-    gPendingTransfer.transferId = transferId;
-    gPendingTransfer.command = command;
-    gPendingTransfer.chunkCount = chunkCount;
-    gPendingTransfer.receivedCount = 0;
-    gPendingTransfer.chunks.assign(chunkCount, "");
+  TransferSlot* slot = nullptr;
+  for (TransferSlot& candidate : gTransferSlots) {
+    if (candidate.active && candidate.transferId == transferId) {
+      slot = &candidate;
+      break;
+    }
   }
 
-  if (chunkIndex < gPendingTransfer.chunkCount && gPendingTransfer.chunks[chunkIndex].isEmpty()) {
-    gPendingTransfer.chunks[chunkIndex] = chunkData;
-    gPendingTransfer.receivedCount++;
+  if (slot == nullptr) {
+    if (chunkIndex != 0) {
+      return;  // Mid-transfer chunk of a transfer we never saw the start of.
+    }
+    for (TransferSlot& candidate : gTransferSlots) {
+      if (!candidate.active) {
+        slot = &candidate;
+        break;
+      }
+    }
+    if (slot == nullptr) {
+      // NACK right away — the hub should back off or retry, not wait out a
+      // response timeout and retransmit the whole payload blind.
+      logWarn(
+          "transport",
+          String("No free transfer slot transfer_id=") + transferId,
+          "transfer_aborted");
+      publishTransferAbort(transferId, "All transfer slots are busy", 503);
+      return;
+    }
+    resetTransferSlot(*slot);
+    slot->active = true;
+    slot->transferId = transferId;
+    slot->command = command;
+    slot->chunkCount = chunkCount;
+    slot->nextChunkIndex = 0;
+    // All chunks are at most as large as the first one, so this reserve makes
+    // the append below allocation-free for the rest of the transfer.
+    slot->decoded.reserve(static_cast<size_t>(chunkCount) * ((chunkLen / 4) * 3));
   }
+  slot->lastChunkAtMs = millis();
 
-  if (gPendingTransfer.receivedCount < gPendingTransfer.chunkCount) {
-    return;  // Still waiting for remaining chunks.
+  if (chunkIndex < slot->nextChunkIndex) {
+    return;  // Duplicate delivery of an already-decoded chunk.
   }
-
-  // All chunks received — reassemble.
-  String fullB64;
-  for (const String& c : gPendingTransfer.chunks) {
-    fullB64 += c;
+  if (chunkIndex != slot->nextChunkIndex || chunkCount != slot->chunkCount) {
+    // MQTT delivers in order per publisher — a gap means the transfer is broken.
+    publishTransferAbort(transferId, "Chunk sequence gap", 400);
+    resetTransferSlot(*slot);
+    return;
   }
-  const String savedCommand = gPendingTransfer.command;
-  gPendingTransfer.active = false;
-  gPendingTransfer.chunks.clear();
-  gPendingTransfer.receivedCount = 0;
 
-  const size_t b64Len = fullB64.length();
-  const size_t maxDecoded = (b64Len / 4) * 3 + 4;
-  std::vector<unsigned char> decoded(maxDecoded);
+  const size_t maxChunkDecoded = (chunkLen / 4) * 3;
+  const size_t writeOffset = slot->decoded.size();
+  slot->decoded.resize(writeOffset + maxChunkDecoded);
   size_t decodedLen = 0;
-  if (mbedtls_base64_decode(decoded.data(), maxDecoded, &decodedLen,
-                              reinterpret_cast<const unsigned char*>(fullB64.c_str()),
-                              b64Len) != 0) {
+  if (mbedtls_base64_decode(slot->decoded.data() + writeOffset, maxChunkDecoded,
+                            &decodedLen,
+                            reinterpret_cast<const unsigned char*>(chunkData), chunkLen) != 0) {
+    publishTransferAbort(transferId, "Chunk decode failed", 400);
+    resetTransferSlot(*slot);
     return;
   }
+  slot->decoded.resize(writeOffset + decodedLen);
+  slot->nextChunkIndex++;
+
+  if (slot->nextChunkIndex < slot->chunkCount) {
+    return;  // Still waiting for remaining chunks.
+  }
 
-  JsonDocument assembledDoc;
-  const DeserializationError err =
-      deserializeJson(assembledDoc, decoded.data(), decodedLen);
+  // The deserialized strings alias the slot's decoded buffer (mutable input
+  // means zero-copy), so the slot is reset only after the command queue has
+  // serialised its own copy.
+  JsonDocument assembledDoc(jsonArena());
+  const DeserializationError err = deserializeJson(
+      assembledDoc, slot->decoded.data(), slot->decoded.size());
   if (err != DeserializationError::Ok) {
+    resetTransferSlot(*slot);
+    publishTransferAbort(transferId, "Assembled payload is not valid JSON", 400);
     return;
   }
 
-  handleCommand(savedCommand, assembledDoc.as<JsonObjectConst>());
+  enqueueCommand(slot->command, assembledDoc.as<JsonObjectConst>());
+  resetTransferSlot(*slot);
 }
 
 void waitForRetainedStateSnapshot() {
@@ -103,14 +198,30 @@ void waitForRetainedStateSnapshot() {
 
 }  // namespace
 
+namespace {
+
+bool topicStartsWith(const char* topic, const char* prefix) {
+  return strncmp(topic, prefix, strlen(prefix)) == 0;
+}
+
+}  // namespace
+
 void onMqttMessage(char* topicChars, byte* payload, unsigned int length) {
-  const String topic(topicChars ? topicChars : "");
+  // No arena-backed document outlives an MQTT callback, so the arena is
+  // clean to reuse for this message.
+  jsonArenaReset();
+  if (topicChars == nullptr) {
+    return;
+  }
+  // Topic dispatch runs on the raw char* against the precomputed topic table;
+  // the hot command path below never materialises a String copy of topic or
+  // payload. Only the rare pairing handlers still take a String topic.
 
   // Restore hub binding from retained state/hub on connect.
-  if (topic == topicStateHub()) {
+  if (strcmp(topicChars, topicStateHub().c_str()) == 0) {
     gRetainedHubStateReceived = true;
-    JsonDocument doc;
-    if (!parsePayloadObject(payload, length, doc)) {
+    JsonDocument doc(jsonArena());
+    if (!parsePayloadObjectInPlace(payload, length, doc)) {
       return;
     }
     const String hubId = String(doc["id"] | "");
@@ -120,10 +231,10 @@ void onMqttMessage(char* topicChars, byte* payload, unsigned int length) {
   }
 
   // Restore operational state from retained state/runtime on connect.
-  if (topic == topicStateRuntime()) {
+  if (strcmp(topicChars, topicStateRuntime().c_str()) == 0) {
     gRetainedRuntimeStateReceived = true;
-    JsonDocument doc;
-    if (!parsePayloadObject(payload, length, doc)) {
+    JsonDocument doc(jsonArena());
+    if (!parsePayloadObjectInPlace(payload, length, doc)) {
       return;
     }
     if (applyRuntimeStateSnapshot(doc.as<JsonObjectConst>())) {
@@ -134,30 +245,33 @@ void onMqttMessage(char* topicChars, byte* payload, unsigned int length) {
     }
     return;
   }
-  if (topic == "ir/pairing/open") {
+  if (strcmp(topicChars, "ir/pairing/open") == 0) {
     handlePairingOpen(payload, length);
     return;
   }
-  if (topic.startsWith("ir/pairing/accept/")) {
-    handlePairingAccept(topic, payload, length);
+  if (topicStartsWith(topicChars, "ir/pairing/accept/")) {
+    handlePairingAccept(String(topicChars), payload, length);
     return;
   }
-  if (topic.startsWith("ir/pairing/unpair/")) {
-    handlePairingUnpair(topic, payload, length);
+  if (topicStartsWith(topicChars, "ir/pairing/unpair/")) {
+    handlePairingUnpair(String(topicChars), payload, length);
     return;
   }
-  if (topic.startsWith("ir/pairing/reclaim/")) {
-    handlePairingReclaim(topic, payload, length);
+  if (topicStartsWith(topicChars, "ir/pairing/reclaim/")) {
+    handlePairingReclaim(String(topicChars), payload, length);
     return;
   }
 
-  String command;
-  if (!parseCommandTopic(topic, command)) {
+  const char* command = nullptr;
+  if (!parseCommandTopic(topicChars, command)) {
     return;
   }
 
-  JsonDocument doc;
-  if (!parsePayloadObject(payload, length, doc)) {
+  // Zero-copy parse: string values alias the payload buffer, which stays
+  // valid for the rest of this callback. The command queue serialises its
+  // own copy, so nothing escapes the buffer's lifetime.
+  JsonDocument doc(jsonArena());
+  if (!parsePayloadObjectInPlace(payload, length, doc)) {
     return;
   }
 
@@ -167,7 +281,7 @@ void onMqttMessage(char* topicChars, byte* payload, unsigned int length) {
     return;
   }
 
-  handleCommand(command, doc.as<JsonObjectConst>());
+  enqueueCommand(command, doc.as<JsonObjectConst>());
 }
 
 bool connectMqtt() {
@@ -186,6 +300,9 @@ bool connectMqtt() {
   gMqttClient.setKeepAlive(60);
   gMqttClient.setCallback(onMqttMessage);
 
+  // Persistent session (clean session = false, the stable client ID is
+  // gAgentId): the broker queues QoS 1 commands published while the agent is
+  // briefly offline, so a WiFi blip delays a press instead of dropping it.
   bool connected = false;
   if (gRuntimeConfig.mqttUser.length() > 0) {
     connected = gMqttClient.connect(
@@ -195,9 +312,18 @@ bool connectMqtt() {
         topicStateAvailability().c_str(),
         1,
         true,
-        "offline");
+        "offline",
+        false);
   } else {
-    connected = gMqttClient.connect(gAgentId.c_str(), topicStateAvailability().c_str(), 1, true, "offline");
+    connected = gMqttClient.connect(
+        gAgentId.c_str(),
+        nullptr,
+        nullptr,
+        topicStateAvailability().c_str(),
+        1,
+        true,
+        "offline",
+        false);
   }
 
   if (!connected) {
@@ -209,6 +335,7 @@ bool connectMqtt() {
     return false;
   }
 
+  metricsNoteMqttReconnect();
   gMqttClient.publish(topicStateAvailability().c_str(), "online", true);
   gRetainedHubStateReceived = false;
   gRetainedRuntimeStateReceived = false;
@@ -219,7 +346,10 @@ bool connectMqtt() {
   gMqttClient.subscribe(topicPairingAccept().c_str());
   gMqttClient.subscribe(topicPairingUnpair().c_str());
   gMqttClient.subscribe(topicPairingReclaim().c_str());
-  gMqttClient.subscribe(topicCommands().c_str());
+  // QoS 1 so queued commands survive short disconnects. PubSubClient does
+  // not expose the CONNACK session-present flag, so the subscribes are still
+  // issued on every reconnect — they are idempotent on the broker.
+  gMqttClient.subscribe(topicCommands().c_str(), 1);
   publishState();
   flushQueuedLogs();
   logInfo(
@@ -230,4 +360,21 @@ bool connectMqtt() {
   return true;
 }
 
+
+void processTransferTimeouts() {
+  const unsigned long now = millis();
+  for (TransferSlot& slot : gTransferSlots) {
+    if (!slot.active || now - slot.lastChunkAtMs < kTransferChunkTimeoutMs) {
+      continue;
+    }
+    logWarn(
+        "transport",
+        String("Chunked transfer timed out transfer_id=") + slot.transferId
+            + " received_chunks=" + String(slot.nextChunkIndex) + "/" + String(slot.chunkCount),
+        "transfer_aborted");
+    publishTransferAbort(slot.transferId, "Transfer timed out waiting for next chunk", 408);
+    resetTransferSlot(slot);
+  }
+}
+
 }  // namespace agent
@@ -7,4 +7,8 @@ namespace agent {
 void onMqttMessage(char* topicChars, byte* payload, unsigned int length);
 bool connectMqtt();
 
+// Aborts chunked transfers whose next chunk never arrived and NACKs them to
+// the hub. Called from processBackgroundTasks().
+void processTransferTimeouts();
+
 }  // namespace agent
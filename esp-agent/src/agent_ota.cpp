@@ -1,19 +1,83 @@
 #include "agent_ota.h"
 
+#include "agent_logs.h"
 #include "agent_state.h"
 
 #include <HTTPClient.h>
 #include <Update.h>
 #include <WiFi.h>
 #include <esp_task_wdt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 #include <mbedtls/sha256.h>
 
 #include <algorithm>
+#include <new>
 
 namespace agent {
 
 namespace {
 
+constexpr size_t kOtaBufferSize = 8192;
+constexpr size_t kOtaBufferCount = 4;
+constexpr uint32_t kOtaWriterStackWords = 4096;
+constexpr UBaseType_t kOtaWriterPriority = 2;
+constexpr BaseType_t kOtaWriterCore = 1;
+// A stalled stream is abandoned quickly because a Range resume is cheap; the
+// old 60 s wait only made sense when a stall meant restarting from byte zero.
+constexpr unsigned long kOtaStreamStallTimeoutMs = 15000;
+constexpr int kOtaMaxResumeAttempts = 5;
+constexpr unsigned long kOtaResumeBackoffBaseMs = 2000;  // Doubles per attempt, capped at 16 s.
+
+// One pipeline buffer: filled from the network by performOta, flashed and
+// hashed by the writer task.
+struct OtaBuffer {
+  size_t length = 0;
+  uint8_t data[kOtaBufferSize];
+};
+
+struct OtaPipeline {
+  QueueHandle_t freeQueue = nullptr;    // Buffers ready to be filled.
+  QueueHandle_t filledQueue = nullptr;  // Buffers ready to flash; nullptr = end of stream.
+  mbedtls_sha256_context shaCtx;
+  volatile bool writerFailed = false;
+  volatile bool writerDone = false;
+  // Valid once writerDone is set; the producer must not read them earlier.
+  String writerErrorCode;
+  String writerMessage;
+};
+
+// Flash writer: consumes filled buffers, feeds the SHA-256 context (routed to
+// the hardware accelerator by the IDF mbedtls port) and writes to the OTA
+// partition, while performOta keeps reading the next buffers off the socket.
+// The flash erase stall and the TCP receive overlap instead of alternating,
+// which roughly halves download+flash time with the old single 1 KB buffer.
+void otaWriterTask(void* arg) {
+  OtaPipeline* pipeline = static_cast<OtaPipeline*>(arg);
+  for (;;) {
+    OtaBuffer* buffer = nullptr;
+    if (xQueueReceive(pipeline->filledQueue, &buffer, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    if (buffer == nullptr) {
+      break;  // End-of-stream sentinel from the producer.
+    }
+    if (!pipeline->writerFailed) {
+      mbedtls_sha256_update_ret(&pipeline->shaCtx, buffer->data, buffer->length);
+      const size_t bytesWritten = Update.write(buffer->data, buffer->length);
+      if (bytesWritten != buffer->length) {
+        pipeline->writerErrorCode = "ota_flash_write_failed";
+        pipeline->writerMessage = Update.errorString();
+        pipeline->writerFailed = true;
+      }
+    }
+    xQueueSend(pipeline->freeQueue, &buffer, portMAX_DELAY);
+  }
+  pipeline->writerDone = true;
+  vTaskDelete(nullptr);
+}
+
 String sha256ToHex(const uint8_t* digest, size_t length) {
   static const char* hex = "0123456789abcdef";
   String output;
@@ -37,45 +101,124 @@ OtaResult performOta(
   result.ok = false;
 
   HTTPClient http;
-  if (!http.begin(url)) {
-    result.errorCode = "ota_http_begin_failed";
-    result.message = "Failed to open firmware URL";
-    return result;
-  }
+  int totalBytes = -1;
+  size_t downloadedBytes = 0;
 
-  const int statusCode = http.GET();
-  if (statusCode != HTTP_CODE_OK) {
-    result.errorCode = "ota_http_status_invalid";
-    result.message = String("HTTP status ") + statusCode;
+  // Opens (or re-opens) the firmware stream. A resume attempt asks the server
+  // for the unwritten tail via a Range header; anything but 206 there means
+  // the server would restart from byte zero, which cannot be spliced into the
+  // partially written partition.
+  auto openStream = [&](String& errCode, String& errMessage) -> WiFiClient* {
     http.end();
-    return result;
-  }
+    if (!http.begin(url)) {
+      errCode = "ota_http_begin_failed";
+      errMessage = "Failed to open firmware URL";
+      return nullptr;
+    }
+    if (downloadedBytes > 0) {
+      http.addHeader("Range", String("bytes=") + String(downloadedBytes) + "-");
+    }
+    const int statusCode = http.GET();
+    if (downloadedBytes == 0) {
+      if (statusCode != HTTP_CODE_OK) {
+        errCode = "ota_http_status_invalid";
+        errMessage = String("HTTP status ") + statusCode;
+        return nullptr;
+      }
+      totalBytes = http.getSize();
+    } else if (statusCode != HTTP_CODE_PARTIAL_CONTENT) {
+      errCode = "ota_resume_unsupported";
+      errMessage = String("HTTP status ") + statusCode + " for ranged request";
+      return nullptr;
+    }
+    WiFiClient* streamPtr = http.getStreamPtr();
+    if (streamPtr == nullptr) {
+      errCode = "ota_stream_missing";
+      errMessage = "Firmware stream is not available";
+    }
+    return streamPtr;
+  };
 
-  int remaining = http.getSize();
-  const int totalBytes = remaining;
-  WiFiClient* stream = http.getStreamPtr();
-  if (!stream) {
-    result.errorCode = "ota_stream_missing";
-    result.message = "Firmware stream is not available";
+  String connectError;
+  String connectMessage;
+  WiFiClient* stream = openStream(connectError, connectMessage);
+  if (stream == nullptr) {
+    result.errorCode = connectError;
+    result.message = connectMessage;
     http.end();
     return result;
   }
 
-  if (!Update.begin((remaining > 0) ? static_cast<size_t>(remaining) : UPDATE_SIZE_UNKNOWN)) {
+  if (!Update.begin((totalBytes > 0) ? static_cast<size_t>(totalBytes) : UPDATE_SIZE_UNKNOWN)) {
     result.errorCode = "ota_update_begin_failed";
     result.message = Update.errorString();
     http.end();
     return result;
   }
 
-  mbedtls_sha256_context shaCtx;
-  mbedtls_sha256_init(&shaCtx);
-  mbedtls_sha256_starts_ret(&shaCtx, 0);
+  OtaPipeline pipeline;
+  mbedtls_sha256_init(&pipeline.shaCtx);
+  mbedtls_sha256_starts_ret(&pipeline.shaCtx, 0);
+
+  OtaBuffer* buffers[kOtaBufferCount] = {nullptr};
+  pipeline.freeQueue = xQueueCreate(kOtaBufferCount, sizeof(OtaBuffer*));
+  // +1 slot so the end-of-stream sentinel never blocks behind a full ring.
+  pipeline.filledQueue = xQueueCreate(kOtaBufferCount + 1, sizeof(OtaBuffer*));
+  bool pipelineReady = (pipeline.freeQueue != nullptr) && (pipeline.filledQueue != nullptr);
+  for (size_t i = 0; pipelineReady && i < kOtaBufferCount; i++) {
+    buffers[i] = new (std::nothrow) OtaBuffer();
+    if (buffers[i] == nullptr) {
+      pipelineReady = false;
+    } else {
+      xQueueSend(pipeline.freeQueue, &buffers[i], 0);
+    }
+  }
+
+  auto releasePipeline = [&]() {
+    for (size_t i = 0; i < kOtaBufferCount; i++) {
+      delete buffers[i];
+      buffers[i] = nullptr;
+    }
+    if (pipeline.freeQueue != nullptr) {
+      vQueueDelete(pipeline.freeQueue);
+    }
+    if (pipeline.filledQueue != nullptr) {
+      vQueueDelete(pipeline.filledQueue);
+    }
+    mbedtls_sha256_free(&pipeline.shaCtx);
+  };
+
+  TaskHandle_t writerHandle = nullptr;
+  if (pipelineReady
+      && xTaskCreatePinnedToCore(
+             otaWriterTask, "ota_writer", kOtaWriterStackWords, &pipeline, kOtaWriterPriority,
+             &writerHandle, kOtaWriterCore)
+          != pdPASS) {
+    pipelineReady = false;
+  }
+  if (!pipelineReady) {
+    Update.abort();
+    releasePipeline();
+    result.errorCode = "ota_pipeline_alloc_failed";
+    result.message = "Failed to allocate OTA pipeline";
+    http.end();
+    return result;
+  }
+
+  // Blocks until the writer has flashed everything queued so far. The writer
+  // owns the SHA context until the sentinel comes back, so every exit path
+  // below must pass through here before touching it or tearing down buffers.
+  auto drainPipeline = [&]() {
+    OtaBuffer* sentinel = nullptr;
+    xQueueSend(pipeline.filledQueue, &sentinel, portMAX_DELAY);
+    while (!pipeline.writerDone) {
+      gMqttClient.loop();
+      delay(1);
+    }
+  };
 
-  uint8_t buffer[1024];
   unsigned long lastDataAtMs = millis();
   unsigned long lastProgressAtMs = 0;
-  size_t downloadedBytes = 0;
 
   auto emitProgress = [&](const String& status, int progressPct, const String& message, bool force) {
     if (!onProgress) {
@@ -97,97 +240,175 @@ OtaResult performOta(
 
   emitProgress("downloading", totalBytes > 0 ? 0 : -1, "Downloading firmware", true);
 
-  while (http.connected() && (remaining > 0 || remaining == -1)) {
-    gMqttClient.loop();
-    if (shouldCancel && shouldCancel()) {
-      Update.abort();
-      mbedtls_sha256_free(&shaCtx);
-      result.errorCode = "ota_cancelled";
-      result.message = "OTA update cancelled";
-      http.end();
-      return result;
-    }
+  bool cancelled = false;
+  String streamError;
+  String streamMessage;
+  int resumeAttempts = 0;
 
-    const size_t available = stream->available();
-    if (available == 0) {
+  for (;;) {
+    int remaining = (totalBytes > 0) ? (totalBytes - static_cast<int>(downloadedBytes)) : -1;
+    lastDataAtMs = millis();
+
+    while (http.connected() && (remaining > 0 || remaining == -1)) {
+      gMqttClient.loop();
+      esp_task_wdt_reset();  // Explicitly feed the watchdog; flash sector erases can block interrupts briefly.
       if (shouldCancel && shouldCancel()) {
-        Update.abort();
-        mbedtls_sha256_free(&shaCtx);
-        result.errorCode = "ota_cancelled";
-        result.message = "OTA update cancelled";
-        http.end();
-        return result;
+        cancelled = true;
+        break;
       }
-      if (millis() - lastDataAtMs > 60000UL) {
-        Update.abort();
-        mbedtls_sha256_free(&shaCtx);
-        result.errorCode = "ota_stream_timeout";
-        result.message = "Firmware stream timed out";
-        http.end();
-        return result;
+      if (pipeline.writerFailed) {
+        break;
       }
-      delay(1);
-      continue;
+
+      const size_t available = stream->available();
+      if (available == 0) {
+        if (millis() - lastDataAtMs > kOtaStreamStallTimeoutMs) {
+          streamError = "ota_stream_timeout";
+          streamMessage = "Firmware stream timed out";
+          break;
+        }
+        delay(1);
+        continue;
+      }
+
+      // Take a free buffer; keep MQTT serviced while the writer drains the ring.
+      OtaBuffer* buffer = nullptr;
+      while (!cancelled && !pipeline.writerFailed
+             && xQueueReceive(pipeline.freeQueue, &buffer, pdMS_TO_TICKS(20)) != pdTRUE) {
+        gMqttClient.loop();
+        esp_task_wdt_reset();
+        if (shouldCancel && shouldCancel()) {
+          cancelled = true;
+        }
+      }
+      if (cancelled || pipeline.writerFailed || buffer == nullptr) {
+        break;
+      }
+
+      const size_t readSize = std::min(available, sizeof(buffer->data));
+      const int bytesRead = stream->readBytes(buffer->data, readSize);
+      if (bytesRead <= 0) {
+        xQueueSend(pipeline.freeQueue, &buffer, portMAX_DELAY);
+        delay(1);
+        continue;
+      }
+
+      buffer->length = static_cast<size_t>(bytesRead);
+      lastDataAtMs = millis();
+      downloadedBytes += buffer->length;
+      xQueueSend(pipeline.filledQueue, &buffer, portMAX_DELAY);
+
+      if (totalBytes > 0) {
+        const uint64_t numerator = static_cast<uint64_t>(downloadedBytes) * 100ULL;
+        const int progressPct = static_cast<int>(numerator / static_cast<uint64_t>(totalBytes));
+        emitProgress("downloading", progressPct, "Downloading firmware", false);
+      } else {
+        emitProgress("downloading", -1, "Downloading firmware", false);
+      }
+
+      if (remaining > 0) {
+        remaining -= bytesRead;
+      }
+      yield();
     }
 
-    const size_t readSize = std::min(available, sizeof(buffer));
-    const int bytesRead = stream->readBytes(buffer, readSize);
-    if (bytesRead <= 0) {
-      delay(1);
-      continue;
+    if (cancelled || pipeline.writerFailed) {
+      break;
     }
-    if (shouldCancel && shouldCancel()) {
-      Update.abort();
-      mbedtls_sha256_free(&shaCtx);
-      result.errorCode = "ota_cancelled";
-      result.message = "OTA update cancelled";
-      http.end();
-      return result;
+    if (totalBytes > 0 && downloadedBytes >= static_cast<size_t>(totalBytes)) {
+      streamError = "";
+      streamMessage = "";
+      break;  // Image complete.
+    }
+    if (totalBytes <= 0) {
+      // Without a Content-Length, EOF and a dropped link are indistinguishable
+      // and a Range resume has no defined endpoint — keep the old semantics.
+      break;
     }
 
-    lastDataAtMs = millis();
-    const size_t bytesWritten = Update.write(buffer, static_cast<size_t>(bytesRead));
-    gMqttClient.loop();     // Keep MQTT alive immediately after the flash write stall.
-    esp_task_wdt_reset();   // Explicitly feed the watchdog; flash sector erases can block interrupts briefly.
-    if (bytesWritten != static_cast<size_t>(bytesRead)) {
-      Update.abort();
-      mbedtls_sha256_free(&shaCtx);
-      result.errorCode = "ota_flash_write_failed";
-      result.message = Update.errorString();
-      http.end();
-      return result;
-    }
-    mbedtls_sha256_update_ret(&shaCtx, buffer, static_cast<size_t>(bytesRead));
-    downloadedBytes += static_cast<size_t>(bytesRead);
-
-    if (totalBytes > 0) {
-      const uint64_t numerator = static_cast<uint64_t>(downloadedBytes) * 100ULL;
-      const int progressPct = static_cast<int>(numerator / static_cast<uint64_t>(totalBytes));
-      emitProgress("downloading", progressPct, "Downloading firmware", false);
-    } else {
-      emitProgress("downloading", -1, "Downloading firmware", false);
+    // Short read: the link dropped or stalled mid-image. Resume the unwritten
+    // tail with a Range request instead of failing the whole request back to
+    // the hub; flash offset and SHA state survive in the running pipeline.
+    resumeAttempts++;
+    if (resumeAttempts > kOtaMaxResumeAttempts) {
+      if (streamError.isEmpty()) {
+        streamError = "ota_stream_timeout";
+        streamMessage = "Firmware stream kept failing";
+      }
+      break;
     }
+    logWarn("runtime",
+            String("Firmware download interrupted; resuming offset=") + String(downloadedBytes)
+                + " attempt=" + String(resumeAttempts),
+            "ota_resume");
 
-    if (remaining > 0) {
-      remaining -= bytesRead;
+    if (WiFi.status() != WL_CONNECTED) {
+      WiFi.reconnect();
+    }
+    const unsigned long backoffMs =
+        kOtaResumeBackoffBaseMs * (1UL << std::min(resumeAttempts - 1, 3));
+    const unsigned long backoffUntilMs = millis() + backoffMs;
+    while (millis() < backoffUntilMs) {
+      gMqttClient.loop();
+      esp_task_wdt_reset();
+      if (shouldCancel && shouldCancel()) {
+        cancelled = true;
+        break;
+      }
+      delay(20);
+    }
+    if (cancelled) {
+      break;
+    }
+
+    streamError = "";
+    streamMessage = "";
+    String resumeError;
+    String resumeMessage;
+    stream = openStream(resumeError, resumeMessage);
+    if (stream == nullptr) {
+      streamError = resumeError;
+      streamMessage = resumeMessage;
+      if (streamError == "ota_resume_unsupported") {
+        break;  // The server ignores Range; retrying cannot help.
+      }
+      continue;  // Connect failure counts against the next attempt.
     }
-    yield();
+    emitProgress("downloading", -1, "Resuming firmware download", true);
   }
 
-  if (shouldCancel && shouldCancel()) {
+  drainPipeline();
+
+  if (cancelled || (shouldCancel && shouldCancel())) {
     Update.abort();
-    mbedtls_sha256_free(&shaCtx);
+    releasePipeline();
     result.errorCode = "ota_cancelled";
     result.message = "OTA update cancelled";
     http.end();
     return result;
   }
+  if (pipeline.writerFailed) {
+    Update.abort();
+    result.errorCode = pipeline.writerErrorCode;
+    result.message = pipeline.writerMessage;
+    releasePipeline();
+    http.end();
+    return result;
+  }
+  if (!streamError.isEmpty()) {
+    Update.abort();
+    releasePipeline();
+    result.errorCode = streamError;
+    result.message = streamMessage;
+    http.end();
+    return result;
+  }
 
   emitProgress("installing", -1, "Installing firmware", true);
 
   uint8_t digest[32];
-  mbedtls_sha256_finish_ret(&shaCtx, digest);
-  mbedtls_sha256_free(&shaCtx);
+  mbedtls_sha256_finish_ret(&pipeline.shaCtx, digest);
+  releasePipeline();
 
   result.actualSha256 = sha256ToHex(digest, sizeof(digest));
   const String normalizedExpected = normalizeSha256(expectedSha256);
@@ -1,10 +1,14 @@
 #include "agent_runtime_state.h"
 
+#include "agent_commands.h"
 #include "agent_ir.h"
+#include "agent_json_arena.h"
 #include "agent_logs.h"
+#include "agent_metrics.h"
 #include "agent_state.h"
 
 #include <WiFi.h>
+#include <esp_heap_caps.h>
 
 namespace agent {
 
@@ -18,55 +22,106 @@ bool mqttPublishJson(const String& topic, JsonDocument& doc, bool retain) {
   return gMqttClient.publish(topic.c_str(), payload.c_str(), retain);
 }
 
+namespace {
+
+// Last payload published per subtopic — unchanged documents are skipped so a
+// heartbeat normally touches only the subtopics that actually moved (version
+// and agent capabilities literally never change between boots).
+String gLastHubPayload;
+String gLastVersionPayload;
+String gLastAgentPayload;
+String gLastRuntimePayload;
+unsigned long gLastStateFullRefreshMs = 0;
+
+void publishStateSubtopic(const String& topic, JsonDocument& doc, bool retain,
+                          String& lastPayload, bool force) {
+  String payload;
+  payload.reserve(256);
+  serializeJson(doc, payload);
+  if (!force && payload == lastPayload) {
+    return;
+  }
+  if (gMqttClient.publish(topic.c_str(), payload.c_str(), retain)) {
+    lastPayload = payload;
+  }
+}
+
+}  // namespace
+
 void publishState() {
   if (!gMqttClient.connected()) {
     return;
   }
 
+  const unsigned long now = millis();
+  const bool force = (gLastStateFullRefreshMs == 0) ||
+      (now - gLastStateFullRefreshMs > kStateFullRefreshMs);
+  if (force) {
+    gLastStateFullRefreshMs = now;
+  }
+
   // state/hub — pairing binding (retained)
   {
-    JsonDocument doc;
+    JsonDocument doc(jsonArena());
     doc["id"] = gPairingHubId;
-    mqttPublishJson(topicStateHub(), doc, true);
+    publishStateSubtopic(topicStateHub(), doc, true, gLastHubPayload, force);
   }
 
   // state/version — firmware + protocol versions (retained)
   {
-    JsonDocument doc;
+    JsonDocument doc(jsonArena());
     doc["sw_version"] = kFirmwareVersion;
     doc["system"] = kSystemVersion;
     doc["send"] = kSendVersion;
     doc["learn"] = kLearnVersion;
-    mqttPublishJson(topicStateVersion(), doc, true);
+    publishStateSubtopic(topicStateVersion(), doc, true, gLastVersionPayload, force);
   }
 
   // state/agent — static capabilities (retained)
   {
-    JsonDocument doc;
+    JsonDocument doc(jsonArena());
     doc["agent_type"] = kAgentType;
     doc["can_send"] = canSend();
     doc["can_learn"] = canLearn();
     doc["ota_supported"] = true;
-    mqttPublishJson(topicStateAgent(), doc, true);
+    JsonArray encodings = doc["encodings"].to<JsonArray>();
+    encodings.add("raw");
+    encodings.add("raw_binary");
+    encodings.add("protocol");
+    JsonArray protocols = doc["protocols"].to<JsonArray>();
+    for (size_t i = 0; i < supportedProtocolCount(); i++) {
+      protocols.add(supportedProtocolName(i));
+    }
+    publishStateSubtopic(topicStateAgent(), doc, true, gLastAgentPayload, force);
   }
 
   // state/runtime — mutable operational state (retained)
   {
-    JsonDocument doc;
+    JsonDocument doc(jsonArena());
     doc["debug"] = gDebugEnabled;
     doc["reboot_required"] = gRebootRequired;
     doc["ir_tx_pin"] = gRuntimeConfig.irTxPin;
     doc["ir_rx_pin"] = gRuntimeConfig.irRxPin;
-    mqttPublishJson(topicStateRuntime(), doc, true);
+    doc["power_profile"] = gRuntimeConfig.powerProfile;
+    publishStateSubtopic(topicStateRuntime(), doc, true, gLastRuntimePayload, force);
   }
 
-  // state/diagnostics — point-in-time data, not retained
+  // state/diagnostics — point-in-time data, not retained and always published
   {
-    JsonDocument doc;
+    JsonDocument doc(jsonArena());
     doc["free_heap"] = ESP.getFreeHeap();
     doc["last_reset_reason"] = currentResetReasonText();
     doc["last_reset_code"] = currentResetReasonCode();
     doc["last_reset_crash"] = currentResetIndicatesCrash();
+    JsonObject load = doc["load"].to<JsonObject>();
+    load["free_heap"] = ESP.getFreeHeap();
+    load["largest_free_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    load["queue_depth"] = pendingWorkDepth();
+    JsonObject arena = doc["json_arena"].to<JsonObject>();
+    arena["capacity"] = jsonArenaCapacity();
+    arena["high_water"] = jsonArenaHighWater();
+    arena["heap_fallbacks"] = jsonArenaHeapFallbacks();
+    metricsFillDiagnostics(doc.as<JsonObject>());
     mqttPublishJson(topicStateDiagnostics(), doc, false);
   }
 
@@ -74,13 +129,18 @@ void publishState() {
 }
 
 void applyPowerMode() {
-  const bool shouldEco = !gLearningActive && (millis() > gActiveUntilMs);
+  const bool shouldEco = !gLearningActive && (millis() > gActiveUntilMs)
+      && gRuntimeConfig.powerProfile != kPowerProfilePerformance;
   if (shouldEco == gEcoMode) {
     return;
   }
   gEcoMode = shouldEco;
   if (gEcoMode) {
-    WiFi.setSleep(WIFI_PS_MIN_MODEM);
+    // Battery pairs the deeper modem sleep with light sleep in the main loop
+    // (see waitForNextEvent); balanced stays at the listen-every-DTIM level.
+    WiFi.setSleep(gRuntimeConfig.powerProfile == kPowerProfileBattery
+                      ? WIFI_PS_MAX_MODEM
+                      : WIFI_PS_MIN_MODEM);
   } else {
     WiFi.setSleep(WIFI_PS_NONE);
   }
@@ -0,0 +1,95 @@
+#include "agent_signal_cache.h"
+
+#include "agent_state.h"
+
+#include <Preferences.h>
+
+#include <vector>
+
+namespace agent {
+
+namespace {
+
+// Separate namespace from kPrefsNamespace so cached signals never collide
+// with runtime configuration keys and can be wiped independently.
+constexpr const char* kSignalCacheNamespace = "esp32-ir-sig";
+
+}  // namespace
+
+bool isValidSignalCacheId(const String& signalId) {
+  if (signalId.isEmpty() || signalId.length() > 15U) {
+    return false;
+  }
+  for (size_t i = 0; i < signalId.length(); i++) {
+    const char c = signalId.charAt(i);
+    const bool digit = (c >= '0' && c <= '9');
+    const bool lower = (c >= 'a' && c <= 'z');
+    const bool upper = (c >= 'A' && c <= 'Z');
+    if (!digit && !lower && !upper && c != '_' && c != '-') {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool signalCacheStore(const String& signalId, JsonObjectConst signal, size_t& storedBytes) {
+  storedBytes = 0;
+  String serialized;
+  serialized.reserve(256);
+  serializeJson(signal, serialized);
+  if (serialized.isEmpty()) {
+    return false;
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(kSignalCacheNamespace, false)) {
+    return false;
+  }
+  storedBytes = prefs.putBytes(signalId.c_str(), serialized.c_str(), serialized.length());
+  prefs.end();
+  return storedBytes == serialized.length();
+}
+
+bool signalCacheLoad(const String& signalId, JsonDocument& doc) {
+  Preferences prefs;
+  if (!prefs.begin(kSignalCacheNamespace, true)) {
+    return false;
+  }
+  const size_t length = prefs.getBytesLength(signalId.c_str());
+  if (length == 0) {
+    prefs.end();
+    return false;
+  }
+  std::vector<char> buffer(length);
+  const size_t read = prefs.getBytes(signalId.c_str(), buffer.data(), length);
+  prefs.end();
+  if (read != length) {
+    return false;
+  }
+  // Const input forces copy mode — the buffer dies with this scope, so the
+  // document must own its strings rather than alias them zero-copy.
+  const DeserializationError error =
+      deserializeJson(doc, static_cast<const char*>(buffer.data()), length);
+  return !error && doc.is<JsonObject>();
+}
+
+bool signalCacheEvict(const String& signalId) {
+  Preferences prefs;
+  if (!prefs.begin(kSignalCacheNamespace, false)) {
+    return false;
+  }
+  const bool removed = prefs.remove(signalId.c_str());
+  prefs.end();
+  return removed;
+}
+
+void signalCacheClear() {
+  Preferences prefs;
+  if (!prefs.begin(kSignalCacheNamespace, false)) {
+    return;
+  }
+  prefs.clear();
+  prefs.end();
+}
+
+}  // namespace agent
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <ArduinoJson.h>
+
+namespace agent {
+
+// Persistent signal cache in NVS, keyed by a hub-assigned signal ID. Cached
+// entries hold the full signal descriptor (encoding, frames, carrier, hold
+// parameters) so a send command can reference a ~100-byte signal_id instead
+// of shipping a multi-KB frame on every press.
+
+// Hub-assigned IDs must fit an NVS key: 1-15 chars of [a-z A-Z 0-9 _ -].
+bool isValidSignalCacheId(const String& signalId);
+
+// Serializes the signal object into NVS. Returns false with storedBytes == 0
+// when the write fails (e.g. the partition is full).
+bool signalCacheStore(const String& signalId, JsonObjectConst signal, size_t& storedBytes);
+
+// Loads a cached signal descriptor into doc. Returns false when the ID is unknown.
+bool signalCacheLoad(const String& signalId, JsonDocument& doc);
+
+bool signalCacheEvict(const String& signalId);
+void signalCacheClear();
+
+}  // namespace agent
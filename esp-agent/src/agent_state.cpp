@@ -1,8 +1,10 @@
 #include "agent_state.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 
 namespace agent {
 
@@ -61,70 +63,172 @@ String nowSecondsText() {
   return String(seconds, 3);
 }
 
-String topicStateAvailability() {
-  return String("ir/agents/") + gAgentId + "/state/availability";
+namespace {
+
+// Fixed topics built once per boot — every accessor below used to rebuild
+// its String on each call, fragmenting the heap over long uptimes.
+struct TopicTable {
+  String stateAvailability;
+  String stateHub;
+  String stateVersion;
+  String stateAgent;
+  String stateRuntime;
+  String stateDiagnostics;
+  String commands;
+  String commandPrefix;  // "ir/agents/<id>/cmd/" — for parseCommandTopic
+  String installationState;
+  String logs;
+  String pairingAccept;
+  String pairingUnpair;
+  String pairingUnpairAck;
+  String pairingReclaim;
+};
+
+TopicTable gTopics;
+
+}  // namespace
+
+void initTopicTable() {
+  const String base = String("ir/agents/") + gAgentId;
+  gTopics.stateAvailability = base + "/state/availability";
+  gTopics.stateHub = base + "/state/hub";
+  gTopics.stateVersion = base + "/state/version";
+  gTopics.stateAgent = base + "/state/agent";
+  gTopics.stateRuntime = base + "/state/runtime";
+  gTopics.stateDiagnostics = base + "/state/diagnostics";
+  gTopics.commands = base + "/cmd/#";
+  gTopics.commandPrefix = base + "/cmd/";
+  gTopics.installationState = base + "/installation/state";
+  gTopics.logs = base + "/logs";
+  gTopics.pairingAccept = String("ir/pairing/accept/+/") + gAgentId;
+  gTopics.pairingUnpair = String("ir/pairing/unpair/") + gAgentId;
+  gTopics.pairingUnpairAck = String("ir/pairing/unpair_ack/") + gAgentId;
+  gTopics.pairingReclaim = String("ir/pairing/reclaim/") + gAgentId;
+}
+
+const String& topicStateAvailability() {
+  return gTopics.stateAvailability;
 }
 
-String topicStateHub() {
-  return String("ir/agents/") + gAgentId + "/state/hub";
+const String& topicStateHub() {
+  return gTopics.stateHub;
 }
 
-String topicStateVersion() {
-  return String("ir/agents/") + gAgentId + "/state/version";
+const String& topicStateVersion() {
+  return gTopics.stateVersion;
 }
 
-String topicStateAgent() {
-  return String("ir/agents/") + gAgentId + "/state/agent";
+const String& topicStateAgent() {
+  return gTopics.stateAgent;
 }
 
-String topicStateRuntime() {
-  return String("ir/agents/") + gAgentId + "/state/runtime";
+const String& topicStateRuntime() {
+  return gTopics.stateRuntime;
 }
 
-String topicStateDiagnostics() {
-  return String("ir/agents/") + gAgentId + "/state/diagnostics";
+const String& topicStateDiagnostics() {
+  return gTopics.stateDiagnostics;
 }
 
-String topicCommands() {
-  return String("ir/agents/") + gAgentId + "/cmd/#";
+const String& topicCommands() {
+  return gTopics.commands;
 }
 
-String topicInstallationState() {
-  return String("ir/agents/") + gAgentId + "/installation/state";
+const String& topicInstallationState() {
+  return gTopics.installationState;
 }
 
-String topicLogs() {
-  return String("ir/agents/") + gAgentId + "/logs";
+const String& topicLogs() {
+  return gTopics.logs;
 }
 
-String topicPairingAccept() {
-  return String("ir/pairing/accept/+/") + gAgentId;
+const String& topicPairingAccept() {
+  return gTopics.pairingAccept;
 }
 
-String topicPairingUnpair() {
-  return String("ir/pairing/unpair/") + gAgentId;
+const String& topicPairingUnpair() {
+  return gTopics.pairingUnpair;
 }
 
-String topicPairingUnpairAck() {
-  return String("ir/pairing/unpair_ack/") + gAgentId;
+const String& topicPairingUnpairAck() {
+  return gTopics.pairingUnpairAck;
 }
 
-String topicPairingReclaim() {
-  return String("ir/pairing/reclaim/") + gAgentId;
+const String& topicPairingReclaim() {
+  return gTopics.pairingReclaim;
 }
 
 String topicResponse(const String& hubId, const String& requestId) {
   return String("ir/hubs/") + hubId + "/agents/" + gAgentId + "/resp/" + requestId;
 }
 
+namespace {
+
+// Persisted config layout, written as a single NVS blob so saving is one
+// flash commit instead of one per key — the save path runs right before a
+// scheduled reboot, so commit latency matters. Fixed-size fields keep the
+// layout stable; bump kConfigBlobVersion when it changes. A trailing CRC
+// rejects torn writes so a crash mid-save falls back cleanly.
+// Version 2 adds the power profile field.
+constexpr uint16_t kConfigBlobVersion = 2;
+constexpr const char* kConfigBlobKey = "cfg_blob";
+
+struct PersistedConfigBlob {
+  uint16_t version;
+  uint16_t mqttPort;
+  int32_t irTxPin;
+  int32_t irRxPin;
+  uint8_t debug;
+  uint8_t rebootRequired;
+  char mqttHost[65];
+  char mqttUser[49];
+  char mqttPass[65];
+  char staticIp[16];
+  char staticGateway[16];
+  char staticNetmask[16];
+  char staticDns[16];
+  char powerProfile[16];
+  uint32_t crc;  // CRC-32 over every preceding byte, padding included.
+};
+
+uint32_t crc32Bytes(const uint8_t* data, size_t length) {
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+uint32_t configBlobCrc(const PersistedConfigBlob& blob) {
+  return crc32Bytes(reinterpret_cast<const uint8_t*>(&blob), offsetof(PersistedConfigBlob, crc));
+}
+
+}  // namespace
+
 void saveRuntimeConfig() {
+  // Zero-init so padding and unused field tails are deterministic for the CRC.
+  PersistedConfigBlob blob = {};
+  blob.version = kConfigBlobVersion;
+  blob.mqttPort = gRuntimeConfig.mqttPort;
+  blob.irTxPin = gRuntimeConfig.irTxPin;
+  blob.irRxPin = gRuntimeConfig.irRxPin;
+  blob.debug = gDebugEnabled ? 1 : 0;
+  blob.rebootRequired = gRebootRequired ? 1 : 0;
+  strlcpy(blob.mqttHost, gRuntimeConfig.mqttHost.c_str(), sizeof(blob.mqttHost));
+  strlcpy(blob.mqttUser, gRuntimeConfig.mqttUser.c_str(), sizeof(blob.mqttUser));
+  strlcpy(blob.mqttPass, gRuntimeConfig.mqttPass.c_str(), sizeof(blob.mqttPass));
+  strlcpy(blob.staticIp, gRuntimeConfig.staticIp.c_str(), sizeof(blob.staticIp));
+  strlcpy(blob.staticGateway, gRuntimeConfig.staticGateway.c_str(), sizeof(blob.staticGateway));
+  strlcpy(blob.staticNetmask, gRuntimeConfig.staticNetmask.c_str(), sizeof(blob.staticNetmask));
+  strlcpy(blob.staticDns, gRuntimeConfig.staticDns.c_str(), sizeof(blob.staticDns));
+  strlcpy(blob.powerProfile, gRuntimeConfig.powerProfile.c_str(), sizeof(blob.powerProfile));
+  blob.crc = configBlobCrc(blob);
+
   gPrefs.begin(kPrefsNamespace, false);
-  gPrefs.putString("mqtt_host", gRuntimeConfig.mqttHost);
-  gPrefs.putUShort("mqtt_port", gRuntimeConfig.mqttPort);
-  gPrefs.putString("mqtt_user", gRuntimeConfig.mqttUser);
-  gPrefs.putString("mqtt_pass", gRuntimeConfig.mqttPass);
-  gPrefs.putInt("ir_tx_pin", gRuntimeConfig.irTxPin);
-  gPrefs.putInt("ir_rx_pin", gRuntimeConfig.irRxPin);
+  gPrefs.putBytes(kConfigBlobKey, &blob, sizeof(blob));
   gPrefs.end();
 }
 
@@ -134,24 +238,80 @@ void savePairingHubId(const String& hubId) {
 
 void saveDebugFlag(bool enabled) {
   gDebugEnabled = enabled;
+  // Part of the config blob now, so the flag survives a crash or power cut.
+  saveRuntimeConfig();
 }
 
 void saveRebootRequired(bool required) {
   gRebootRequired = required;
+  saveRuntimeConfig();
 }
 
 void loadPersistedState() {
   gPrefs.begin(kPrefsNamespace, false);
-  gRuntimeConfig.mqttHost = gPrefs.getString("mqtt_host", "");
-  gRuntimeConfig.mqttPort = gPrefs.getUShort("mqtt_port", kDefaultMqttPort);
+
+  PersistedConfigBlob blob = {};
+  const bool blobValid = gPrefs.getBytesLength(kConfigBlobKey) == sizeof(blob)
+      && gPrefs.getBytes(kConfigBlobKey, &blob, sizeof(blob)) == sizeof(blob)
+      && blob.version == kConfigBlobVersion
+      && blob.crc == configBlobCrc(blob);
+
+  if (blobValid) {
+    gRuntimeConfig.mqttHost = String(blob.mqttHost);
+    gRuntimeConfig.mqttPort = blob.mqttPort;
+    gRuntimeConfig.mqttUser = String(blob.mqttUser);
+    gRuntimeConfig.mqttPass = String(blob.mqttPass);
+    gRuntimeConfig.irTxPin = blob.irTxPin;
+    gRuntimeConfig.irRxPin = blob.irRxPin;
+    gRuntimeConfig.staticIp = String(blob.staticIp);
+    gRuntimeConfig.staticGateway = String(blob.staticGateway);
+    gRuntimeConfig.staticNetmask = String(blob.staticNetmask);
+    gRuntimeConfig.staticDns = String(blob.staticDns);
+    gRuntimeConfig.powerProfile = String(blob.powerProfile);
+    gDebugEnabled = blob.debug != 0;
+    gRebootRequired = blob.rebootRequired != 0;
+  } else {
+    // No blob (pre-blob firmware, first boot) or a torn/foreign one: read the
+    // legacy per-key layout, then drop those keys — the blob written below
+    // makes this migration run once. The debug and reboot-required flags were
+    // never persisted under the old layout, so their defaults stand.
+    gRuntimeConfig.mqttHost = gPrefs.getString("mqtt_host", "");
+    gRuntimeConfig.mqttPort = gPrefs.getUShort("mqtt_port", kDefaultMqttPort);
+    gRuntimeConfig.mqttUser = gPrefs.getString("mqtt_user", "");
+    gRuntimeConfig.mqttPass = gPrefs.getString("mqtt_pass", "");
+    gRuntimeConfig.irTxPin = gPrefs.getInt("ir_tx_pin", kDefaultIrTxPin);
+    gRuntimeConfig.irRxPin = gPrefs.getInt("ir_rx_pin", kDefaultIrRxPin);
+    gRuntimeConfig.staticIp = gPrefs.getString("static_ip", "");
+    gRuntimeConfig.staticGateway = gPrefs.getString("static_gw", "");
+    gRuntimeConfig.staticNetmask = gPrefs.getString("static_mask", "");
+    gRuntimeConfig.staticDns = gPrefs.getString("static_dns", "");
+  }
   if (gRuntimeConfig.mqttPort == 0) {
     gRuntimeConfig.mqttPort = kDefaultMqttPort;
   }
-  gRuntimeConfig.mqttUser = gPrefs.getString("mqtt_user", "");
-  gRuntimeConfig.mqttPass = gPrefs.getString("mqtt_pass", "");
-  gRuntimeConfig.irTxPin = gPrefs.getInt("ir_tx_pin", kDefaultIrTxPin);
-  gRuntimeConfig.irRxPin = gPrefs.getInt("ir_rx_pin", kDefaultIrRxPin);
+  if (!isValidPowerProfile(gRuntimeConfig.powerProfile)) {
+    gRuntimeConfig.powerProfile = kPowerProfileBalanced;
+  }
   gPrefs.end();
+
+  if (!blobValid) {
+    // Write the blob before touching the legacy keys — a power cut between
+    // the two steps then leaves at least one intact copy of the config
+    // instead of neither.
+    saveRuntimeConfig();
+    gPrefs.begin(kPrefsNamespace, false);
+    gPrefs.remove("mqtt_host");
+    gPrefs.remove("mqtt_port");
+    gPrefs.remove("mqtt_user");
+    gPrefs.remove("mqtt_pass");
+    gPrefs.remove("ir_tx_pin");
+    gPrefs.remove("ir_rx_pin");
+    gPrefs.remove("static_ip");
+    gPrefs.remove("static_gw");
+    gPrefs.remove("static_mask");
+    gPrefs.remove("static_dns");
+    gPrefs.end();
+  }
 }
 
 namespace {
@@ -233,6 +393,14 @@ bool applyRuntimeStateSnapshot(JsonObjectConst payload) {
   if (!rebootRequired.isUnbound()) {
     gRebootRequired = parseBoolStateValue(rebootRequired, gRebootRequired);
   }
+  const JsonVariantConst powerProfile = payload["power_profile"];
+  if (!powerProfile.isUnbound()) {
+    String profile = String(powerProfile | "");
+    profile.trim();
+    if (isValidPowerProfile(profile)) {
+      gRuntimeConfig.powerProfile = profile;
+    }
+  }
   const JsonVariantConst rxPin = payload["ir_rx_pin"];
   if (!rxPin.isUnbound()) {
     const int nextRx = parseStatePin(rxPin, gRuntimeConfig.irRxPin);
@@ -266,6 +434,11 @@ uint16_t parseMqttPort(const String& value, uint16_t fallback) {
   return static_cast<uint16_t>(parsed);
 }
 
+bool isValidPowerProfile(const String& value) {
+  return value == kPowerProfilePerformance || value == kPowerProfileBalanced
+      || value == kPowerProfileBattery;
+}
+
 int parsePin(const String& value, int fallback) {
   String trimmed = value;
   trimmed.trim();
@@ -288,14 +461,14 @@ void scheduleReboot(unsigned long delayMs) {
   gRebootAtMs = millis() + delayMs;
 }
 
-bool parseCommandTopic(const String& topic, String& commandOut) {
-  const String prefix = String("ir/agents/") + gAgentId + "/cmd/";
-  if (!topic.startsWith(prefix)) {
+bool parseCommandTopic(const char* topic, const char*& commandOut) {
+  const String& prefix = gTopics.commandPrefix;
+  if (topic == nullptr || prefix.isEmpty()
+      || strncmp(topic, prefix.c_str(), prefix.length()) != 0) {
     return false;
   }
-  commandOut = topic.substring(prefix.length());
-  commandOut.trim();
-  return !commandOut.isEmpty();
+  commandOut = topic + prefix.length();
+  return *commandOut != '\0';
 }
 
 bool parseAcceptTopic(const String& topic, String& sessionOut) {
@@ -321,6 +494,15 @@ bool parsePayloadObject(const byte* payload, unsigned int length, JsonDocument&
   return !error && doc.is<JsonObject>();
 }
 
+bool parsePayloadObjectInPlace(byte* payload, unsigned int length, JsonDocument& doc) {
+  // Passing a mutable char* switches ArduinoJson to zero-copy mode: string
+  // values point into the buffer instead of being duplicated into the
+  // document's allocator.
+  const DeserializationError error =
+      deserializeJson(doc, reinterpret_cast<char*>(payload), length);
+  return !error && doc.is<JsonObject>();
+}
+
 int majorFromVersion(const String& version) {
   String normalized = version;
   normalized.trim();
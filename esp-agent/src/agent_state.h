@@ -18,6 +18,9 @@ namespace agent {
 constexpr const char* kFirmwareVersion = AGENT_FIRMWARE_VERSION;
 // Protocol version integers — increment the relevant constant for any breaking change.
 constexpr int kSystemVersion = 1;
+// The "raw_binary" encoding is additive (hubs opt in per request), so it is
+// advertised via the encodings capability list in state/agent rather than a
+// breaking send version bump.
 constexpr int kSendVersion = 1;
 constexpr int kLearnVersion = 1;
 constexpr const char* kPrefsNamespace = "esp32-ir";
@@ -31,8 +34,19 @@ constexpr unsigned long kMqttReconnectMaxMs = 60000;
 constexpr unsigned long kWifiReconnectIntervalMs = 30000;
 constexpr unsigned long kActiveWindowMs = 5UL * 60UL * 1000UL;
 constexpr unsigned long kStateHeartbeatMs = 30000;
+// Unchanged state subtopics are skipped on publish; a full refresh at this
+// interval is the safety net against a broker losing a retained message.
+constexpr unsigned long kStateFullRefreshMs = 5UL * 60UL * 1000UL;
 constexpr unsigned long kRebootDelayMs = 350;
 
+// Power profiles: performance never sleeps the radio, balanced (default)
+// drops to modem sleep when idle past kActiveWindowMs, battery additionally
+// light-sleeps the CPU between keepalive windows — commands then wait out
+// the current sleep slice, a bounded latency the hub can show per profile.
+constexpr const char* kPowerProfilePerformance = "performance";
+constexpr const char* kPowerProfileBalanced = "balanced";
+constexpr const char* kPowerProfileBattery = "battery";
+
 struct RuntimeConfig {
   String mqttHost;
   uint16_t mqttPort = kDefaultMqttPort;
@@ -40,6 +54,12 @@ struct RuntimeConfig {
   String mqttPass;
   int irTxPin = kDefaultIrTxPin;
   int irRxPin = kDefaultIrRxPin;
+  // Optional static IP — skips DHCP on boot when all three are set.
+  String staticIp;
+  String staticGateway;
+  String staticNetmask;
+  String staticDns;
+  String powerProfile = kPowerProfileBalanced;
 };
 
 extern Preferences gPrefs;
@@ -71,20 +91,27 @@ String normalizeSha256(const String& value);
 bool isHexSha256(const String& value);
 String nowSecondsText();
 
+// Builds the fixed topic table once gAgentId is known. Must run in setup()
+// before any topic accessor below is used — the accessors return references
+// into the table instead of concatenating Strings on every call, which keeps
+// the 30 s heartbeat and the command hot path free of allocator churn.
+void initTopicTable();
+
 // State subtopics (all retained except diagnostics)
-String topicStateAvailability();  // LWT: "online" / "offline"
-String topicStateHub();           // {"id": "..."}
-String topicStateVersion();       // {"sw_version": "...", "system": 1, "send": 1, "learn": 1}
-String topicStateAgent();         // {"agent_type": "...", "can_send": true, ...}
-String topicStateRuntime();       // {"debug": false, "reboot_required": false, "ir_rx_pin": ..., "ir_tx_pin": ...}
-String topicStateDiagnostics();   // {"free_heap": ..., "last_reset_reason": ...} — not retained
-String topicCommands();
-String topicInstallationState();
-String topicLogs();
-String topicPairingAccept();
-String topicPairingUnpair();
-String topicPairingUnpairAck();
-String topicPairingReclaim();
+const String& topicStateAvailability();  // LWT: "online" / "offline"
+const String& topicStateHub();           // {"id": "..."}
+const String& topicStateVersion();       // {"sw_version": "...", "system": 1, "send": 1, "learn": 1}
+const String& topicStateAgent();         // {"agent_type": "...", "can_send": true, ...}
+const String& topicStateRuntime();       // {"debug": false, "reboot_required": false, "ir_rx_pin": ..., "ir_tx_pin": ...}
+const String& topicStateDiagnostics();   // {"free_heap": ..., "last_reset_reason": ...} — not retained
+const String& topicCommands();
+const String& topicInstallationState();
+const String& topicLogs();
+const String& topicPairingAccept();
+const String& topicPairingUnpair();
+const String& topicPairingUnpairAck();
+const String& topicPairingReclaim();
+// Response topics embed the request id and stay dynamic.
 String topicResponse(const String& hubId, const String& requestId);
 
 void saveRuntimeConfig();
@@ -96,13 +123,19 @@ bool applyRuntimeStateSnapshot(JsonObjectConst payload);
 
 uint16_t parseMqttPort(const String& value, uint16_t fallback);
 int parsePin(const String& value, int fallback);
+bool isValidPowerProfile(const String& value);
 
 void markActivity();
 void scheduleReboot(unsigned long delayMs);
 
-bool parseCommandTopic(const String& topic, String& commandOut);
+// Matches a raw command topic against the precomputed prefix and points
+// commandOut at the suffix — no String copies on the MQTT hot path.
+bool parseCommandTopic(const char* topic, const char*& commandOut);
 bool parseAcceptTopic(const String& topic, String& sessionOut);
 bool parsePayloadObject(const byte* payload, unsigned int length, JsonDocument& doc);
+// Zero-copy variant: string values in doc alias (and unescape in place) the
+// payload buffer, so the document is only valid while the buffer is.
+bool parsePayloadObjectInPlace(byte* payload, unsigned int length, JsonDocument& doc);
 int majorFromVersion(const String& version);
 String buildAgentId();
 
@@ -0,0 +1,136 @@
+#include "ir_codec.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace agent {
+namespace codec {
+
+namespace {
+
+bool isTokenSeparator(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+}  // namespace
+
+bool parseRawDurations(const char* input, std::vector<uint16_t>& out) {
+  out.clear();
+  if (input == nullptr) {
+    return false;
+  }
+  // Scans the text in place — no owning copy, no per-token substrings. The
+  // signal string can alias a zero-copy parsed MQTT payload directly.
+  const char* cursor = input;
+  while (*cursor != '\0') {
+    while (isTokenSeparator(*cursor)) {
+      cursor++;
+    }
+    if (*cursor == '\0') {
+      break;
+    }
+    char* endPtr = nullptr;
+    const long value = strtol(cursor, &endPtr, 10);
+    const bool tokenEnded = (*endPtr == '\0' || isTokenSeparator(*endPtr));
+    if (endPtr == cursor || !tokenEnded || value == 0) {
+      return false;
+    }
+    if (out.empty() && value < 0) {
+      return false;
+    }
+    const uint32_t absolute = static_cast<uint32_t>(std::abs(value));
+    const uint16_t duration = static_cast<uint16_t>(std::min<uint32_t>(absolute, 65535));
+    out.push_back(duration);
+    cursor = endPtr;
+  }
+  return !out.empty();
+}
+
+bool parseHexBytes(const char* input, std::vector<uint8_t>& out) {
+  out.clear();
+  if (input == nullptr) {
+    return false;
+  }
+  const char* cursor = input;
+  while (*cursor != '\0') {
+    while (isTokenSeparator(*cursor)) {
+      cursor++;
+    }
+    if (*cursor == '\0') {
+      break;
+    }
+    char* endPtr = nullptr;
+    const long value = strtol(cursor, &endPtr, 16);
+    const bool tokenEnded = (*endPtr == '\0' || isTokenSeparator(*endPtr));
+    if (endPtr == cursor || !tokenEnded) {
+      return false;
+    }
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+    cursor = endPtr;
+  }
+  return !out.empty();
+}
+
+bool unpackBinaryDurations(const unsigned char* data, size_t length,
+                           std::vector<uint16_t>& out) {
+  out.clear();
+  if (data == nullptr || length == 0 || (length % 2) != 0) {
+    return false;
+  }
+  const size_t count = length / 2;
+  out.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const uint16_t duration = static_cast<uint16_t>(data[2 * i]) |
+                              (static_cast<uint16_t>(data[2 * i + 1]) << 8);
+    if (duration == 0) {
+      out.clear();
+      return false;
+    }
+    out[i] = duration;
+  }
+  return true;
+}
+
+uint32_t estimateTickUs(const std::vector<uint16_t>& durations) {
+  if (durations.size() < 4) {
+    return 0;
+  }
+  // The mean of the shortest-duration cluster. Receiver jitter spreads what
+  // the remote sent as one base unit across tens of microseconds; averaging
+  // the cluster recovers the protocol tick without knowing the protocol.
+  uint16_t minDuration = 0xFFFF;
+  for (const uint16_t value : durations) {
+    if (value < minDuration) {
+      minDuration = value;
+    }
+  }
+  if (minDuration < 100) {
+    return 0;  // Sub-100 us edges are noise, not a protocol tick.
+  }
+  uint32_t clusterSum = 0;
+  uint32_t clusterCount = 0;
+  const uint16_t clusterCeiling = minDuration + (minDuration * 2) / 5;
+  for (const uint16_t value : durations) {
+    if (value <= clusterCeiling) {
+      clusterSum += value;
+      clusterCount++;
+    }
+  }
+  return clusterSum / clusterCount;
+}
+
+void quantizeToTick(std::vector<uint16_t>& durations, uint32_t tick) {
+  if (tick == 0) {
+    return;
+  }
+  for (uint16_t& duration : durations) {
+    uint32_t units = (duration + tick / 2) / tick;
+    if (units == 0) {
+      units = 1;
+    }
+    duration = static_cast<uint16_t>(std::min<uint32_t>(units * tick, 65535));
+  }
+}
+
+}  // namespace codec
+}  // namespace agent
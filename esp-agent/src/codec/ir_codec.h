@@ -0,0 +1,40 @@
+#pragma once
+
+// Host-compilable signal codec — the pure parsing and quantization core
+// shared by the firmware and the [env:native] test/benchmark build. Nothing
+// in this module may touch Arduino, FreeRTOS, or ESP-IDF APIs; the Arduino
+// String and mbedtls glue stays in agent_ir.cpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace agent {
+namespace codec {
+
+// Parses alternating sign-prefixed durations ("+560 -1690 ...") by scanning
+// the text in place. Signs are informative only (durations alternate
+// mark/space by position); the first token must not be negative. Durations
+// clamp to 65535. Returns false on empty input, a zero token, or garbage.
+bool parseRawDurations(const char* input, std::vector<uint16_t>& out);
+
+// Parses space-separated hex byte tokens (e.g. "20 00") into a byte vector.
+// Returns false if any token is malformed or the result is empty.
+bool parseHexBytes(const char* input, std::vector<uint8_t>& out);
+
+// Unpacks little-endian uint16 durations from an already base64-decoded
+// binary frame. Returns false on an odd byte count or a zero duration.
+bool unpackBinaryDurations(const unsigned char* data, size_t length,
+                           std::vector<uint16_t>& out);
+
+// Estimates the protocol base tick from the shortest-duration cluster
+// (everything within 40% of the minimum). Returns 0 when no tick can be
+// estimated: fewer than 4 edges, or a sub-100 us minimum (noise floor).
+uint32_t estimateTickUs(const std::vector<uint16_t>& durations);
+
+// Rounds every duration to the nearest whole number of ticks (minimum one),
+// clamped to 65535. Identical frames then become identical duration lists.
+void quantizeToTick(std::vector<uint16_t>& durations, uint32_t tick);
+
+}  // namespace codec
+}  // namespace agent
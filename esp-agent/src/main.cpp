@@ -3,22 +3,109 @@
 #include "agent_bootstrap.h"
 #include "agent_commands.h"
 #include "agent_ir.h"
+#include "agent_ir_worker.h"
+#include "agent_json_arena.h"
 #include "agent_logs.h"
+#include "agent_metrics.h"
 #include "agent_mqtt.h"
 #include "agent_runtime_state.h"
 #include "agent_state.h"
 
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+#include <lwip/sockets.h>
+
 #include <algorithm>
 
+namespace {
+
+// Upper bound for one idle wait. Short enough that the setup button and WiFi
+// state stay responsive; eco mode trades responsiveness for fewer wakeups.
+constexpr unsigned long kLoopMaxSleepMs = 50;
+constexpr unsigned long kLoopEcoMaxSleepMs = 250;
+// Battery profile: one light-sleep slice. This bounds command wake latency —
+// an inbound publish waits out at most this long before the loop runs again.
+constexpr unsigned long kLoopBatterySleepMaxMs = 2000;
+// Slices shorter than this stay on the select() path; the light-sleep
+// enter/exit overhead is not worth it below here.
+constexpr unsigned long kLightSleepMinMs = 100;
+
+// Clamps the sleep budget to the time left until `dueAtMs`.
+unsigned long clampToDeadline(unsigned long sleepMs, unsigned long dueAtMs) {
+  const unsigned long now = millis();
+  if (dueAtMs <= now) {
+    return 0;
+  }
+  return std::min(sleepMs, dueAtMs - now);
+}
+
+// Blocks until the MQTT socket becomes readable or the next scheduled event
+// (heartbeat, reconnect attempt, reboot, pending background work) is due.
+// An inbound command wakes the loop immediately via select() instead of
+// waiting out a fixed delay, and an idle agent stops polling 200x/s.
+void waitForNextEvent() {
+  const bool batteryIdle = agent::gEcoMode
+      && agent::gRuntimeConfig.powerProfile == agent::kPowerProfileBattery;
+  unsigned long sleepMs = batteryIdle
+      ? kLoopBatterySleepMaxMs
+      : (agent::gEcoMode ? kLoopEcoMaxSleepMs : kLoopMaxSleepMs);
+  sleepMs = std::min(sleepMs, agent::backgroundTaskMaxSleepMs());
+  if (agent::gMqttClient.connected()) {
+    sleepMs = clampToDeadline(sleepMs, agent::gLastStatePublishMs + agent::kStateHeartbeatMs);
+  } else {
+    sleepMs = clampToDeadline(sleepMs, agent::gNextReconnectAtMs);
+  }
+  if (agent::gPendingReboot) {
+    sleepMs = clampToDeadline(sleepMs, agent::gRebootAtMs);
+  }
+  if (sleepMs == 0) {
+    yield();
+    return;
+  }
+
+  if (batteryIdle && sleepMs >= kLightSleepMinMs) {
+    // Light sleep between keepalive windows: CPU and radio stop, RAM and the
+    // WiFi association survive. Wake on the slice timer or — when a receiver
+    // is fitted — on the IR RX line going low, so a remote pointed at a
+    // sleeping agent wakes it (demodulators idle high).
+    esp_sleep_enable_timer_wakeup(static_cast<uint64_t>(sleepMs) * 1000ULL);
+    if (agent::canLearn() && agent::isValidPin(agent::gRuntimeConfig.irRxPin)) {
+      const gpio_num_t rxPin = static_cast<gpio_num_t>(agent::gRuntimeConfig.irRxPin);
+      if (gpio_wakeup_enable(rxPin, GPIO_INTR_LOW_LEVEL) == ESP_OK) {
+        esp_sleep_enable_gpio_wakeup();
+      }
+    }
+    esp_light_sleep_start();
+    return;
+  }
+
+  const int fd = agent::gNetClient.fd();
+  if (fd >= 0) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(fd, &readSet);
+    timeval timeout;
+    timeout.tv_sec = sleepMs / 1000;
+    timeout.tv_usec = static_cast<suseconds_t>((sleepMs % 1000) * 1000);
+    select(fd + 1, &readSet, nullptr, nullptr, &timeout);
+    return;
+  }
+  delay(sleepMs);
+}
+
+}  // namespace
+
 void setup() {
   Serial.begin(115200);
   delay(100);
 
   agent::gAgentId = agent::buildAgentId();
+  agent::initTopicTable();
   agent::logInfo("system", String("Boot sequence started agent_id=") + agent::gAgentId);
   agent::loadPersistedState();
   agent::configureWifiAndRuntime();
   agent::initIrHardware();
+  agent::initIrWorker();
 
   agent::gMqttClient.setClient(agent::gNetClient);
   agent::gMqttClient.setCallback(agent::onMqttMessage);
@@ -30,6 +117,7 @@ void setup() {
 }
 
 void loop() {
+  agent::metricsNoteLoopIteration();
   agent::pollSetupButton();
   agent::pollWifiConnection();
 
@@ -48,6 +136,10 @@ void loop() {
     agent::flushQueuedLogs();
     agent::gMqttClient.loop();
     if (millis() - agent::gLastStatePublishMs > agent::kStateHeartbeatMs) {
+      // Heartbeat publishes allocate from the JSON arena too; without this
+      // reset an idle agent exhausts the arena within a few beats and falls
+      // back to heap. No arena document is live at this point in the loop.
+      agent::jsonArenaReset();
       agent::publishState();
     }
   }
@@ -60,9 +152,7 @@ void loop() {
     ESP.restart();
   }
 
-  if (agent::gEcoMode) {
-    delay(25);
-  } else {
-    delay(5);
-  }
+  agent::metricsNoteLoopSleepStarting();
+  waitForNextEvent();
+  agent::metricsNoteLoopSleepEnded();
 }
@@ -0,0 +1,186 @@
+// Unit tests and micro-benchmarks for the host-compilable codec core.
+// Run with `pio test -e native`. The benchmark cases print ns/edge and
+// bytes/s figures so codec changes ship with before/after numbers; they
+// assert correctness only, not timing, to stay deterministic in CI.
+
+#include <unity.h>
+
+#include "codec/ir_codec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using agent::codec::estimateTickUs;
+using agent::codec::parseHexBytes;
+using agent::codec::parseRawDurations;
+using agent::codec::quantizeToTick;
+using agent::codec::unpackBinaryDurations;
+
+namespace {
+
+// A real captured NEC press (0x20DF10EF, LG power) as the learn path emits
+// it: sign-prefixed, jittered durations straight off the demodulator.
+const char* kNecCapture =
+    "+9034 -4478 +594 -536 +592 -538 +566 -1678 +592 -538 +568 -560 +568 "
+    "-562 +566 -562 +592 -538 +568 -1676 +594 -1652 +592 -538 +568 -1676 "
+    "+568 -1678 +592 -1654 +592 -1654 +592 -1678 +568 -562 +592 -538 +568 "
+    "-562 +568 -1676 +592 -538 +568 -562 +566 -562 +592 -538 +568 -1676 "
+    "+592 -1654 +592 -1678 +568 -562 +592 -1654 +592 -1654 +592 -1678 "
+    "+568 -1676 +592 -39756";
+
+// Builds a synthetic AC-style frame with `edges` entries for throughput runs.
+std::string buildSyntheticFrame(size_t edges) {
+  std::string text;
+  text.reserve(edges * 6);
+  for (size_t i = 0; i < edges; i++) {
+    if (i > 0) {
+      text += ' ';
+    }
+    text += (i % 2 == 0) ? "+437" : "-1300";
+  }
+  return text;
+}
+
+}  // namespace
+
+void test_parse_raw_accepts_signed_capture() {
+  std::vector<uint16_t> out;
+  TEST_ASSERT_TRUE(parseRawDurations(kNecCapture, out));
+  TEST_ASSERT_EQUAL_size_t(68, out.size());
+  TEST_ASSERT_EQUAL_UINT16(9034, out[0]);
+  TEST_ASSERT_EQUAL_UINT16(4478, out[1]);
+  TEST_ASSERT_EQUAL_UINT16(39756, out[67]);
+}
+
+void test_parse_raw_accepts_unsigned_text() {
+  std::vector<uint16_t> out;
+  TEST_ASSERT_TRUE(parseRawDurations("560 1690 560 560", out));
+  TEST_ASSERT_EQUAL_size_t(4, out.size());
+}
+
+void test_parse_raw_rejects_bad_input() {
+  std::vector<uint16_t> out;
+  TEST_ASSERT_FALSE(parseRawDurations(nullptr, out));
+  TEST_ASSERT_FALSE(parseRawDurations("", out));
+  TEST_ASSERT_FALSE(parseRawDurations("   ", out));
+  TEST_ASSERT_FALSE(parseRawDurations("-560 1690", out));  // First edge must be a mark.
+  TEST_ASSERT_FALSE(parseRawDurations("560 0 560", out));
+  TEST_ASSERT_FALSE(parseRawDurations("560 16x90", out));
+}
+
+void test_parse_raw_clamps_oversized_durations() {
+  std::vector<uint16_t> out;
+  TEST_ASSERT_TRUE(parseRawDurations("+560 -99999", out));
+  TEST_ASSERT_EQUAL_UINT16(65535, out[1]);
+}
+
+void test_parse_hex_bytes() {
+  std::vector<uint8_t> out;
+  TEST_ASSERT_TRUE(parseHexBytes("20 DF 10 EF", out));
+  TEST_ASSERT_EQUAL_size_t(4, out.size());
+  TEST_ASSERT_EQUAL_UINT8(0x20, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(0xEF, out[3]);
+  TEST_ASSERT_FALSE(parseHexBytes("", out));
+  TEST_ASSERT_FALSE(parseHexBytes("20 GG", out));
+}
+
+void test_unpack_binary_durations() {
+  const unsigned char packed[] = {0x30, 0x02, 0x9A, 0x06};  // 560, 1690 LE
+  std::vector<uint16_t> out;
+  TEST_ASSERT_TRUE(unpackBinaryDurations(packed, sizeof(packed), out));
+  TEST_ASSERT_EQUAL_size_t(2, out.size());
+  TEST_ASSERT_EQUAL_UINT16(560, out[0]);
+  TEST_ASSERT_EQUAL_UINT16(1690, out[1]);
+
+  const unsigned char zeroDuration[] = {0x00, 0x00};
+  TEST_ASSERT_FALSE(unpackBinaryDurations(zeroDuration, sizeof(zeroDuration), out));
+  TEST_ASSERT_FALSE(unpackBinaryDurations(packed, 3, out));  // Odd length.
+}
+
+void test_quantize_makes_jittered_frames_identical() {
+  std::vector<uint16_t> first;
+  std::vector<uint16_t> second;
+  TEST_ASSERT_TRUE(parseRawDurations("+594 -536 +566 -1678 +592 -538", first));
+  TEST_ASSERT_TRUE(parseRawDurations("+568 -560 +592 -1654 +566 -562", second));
+
+  // Mirrors the burst capture path: the tick is estimated once, from the
+  // first frame, and shared across the window.
+  const uint32_t tick = estimateTickUs(first);
+  TEST_ASSERT_TRUE(tick > 500 && tick < 620);
+  quantizeToTick(first, tick);
+  quantizeToTick(second, tick);
+  TEST_ASSERT_TRUE(first == second);
+}
+
+void test_estimate_tick_rejects_noise() {
+  std::vector<uint16_t> tooShort = {560, 1690};
+  TEST_ASSERT_EQUAL_UINT32(0, estimateTickUs(tooShort));
+  std::vector<uint16_t> noiseFloor = {40, 560, 1690, 560};
+  TEST_ASSERT_EQUAL_UINT32(0, estimateTickUs(noiseFloor));
+}
+
+void test_benchmark_parse_ns_per_edge() {
+  const size_t kEdges = 400;
+  const std::string frame = buildSyntheticFrame(kEdges);
+  const int kIterations = 5000;
+  std::vector<uint16_t> out;
+  out.reserve(kEdges);
+
+  bool ok = true;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    ok = parseRawDurations(frame.c_str(), out) && ok;
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const long long totalNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  printf("parse_raw: %lld ns/edge (%zu edges, %d iterations)\n",
+         totalNs / (static_cast<long long>(kIterations) * kEdges), kEdges,
+         kIterations);
+  TEST_ASSERT_TRUE(ok);
+  TEST_ASSERT_EQUAL_size_t(kEdges, out.size());
+}
+
+void test_benchmark_unpack_bytes_per_s() {
+  const size_t kEdges = 400;
+  std::vector<unsigned char> packed(kEdges * 2);
+  for (size_t i = 0; i < kEdges; i++) {
+    const uint16_t duration = (i % 2 == 0) ? 437 : 1300;
+    packed[2 * i] = static_cast<unsigned char>(duration & 0xFF);
+    packed[2 * i + 1] = static_cast<unsigned char>(duration >> 8);
+  }
+  const int kIterations = 20000;
+  std::vector<uint16_t> out;
+
+  bool ok = true;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    ok = unpackBinaryDurations(packed.data(), packed.size(), out) && ok;
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const long long totalNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  const long long totalBytes = static_cast<long long>(kIterations) * packed.size();
+  if (totalNs > 0) {
+    printf("unpack_binary: %lld MB/s (%zu-byte frames, %d iterations)\n",
+           (totalBytes * 1000LL) / totalNs, packed.size(), kIterations);
+  }
+  TEST_ASSERT_TRUE(ok);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_raw_accepts_signed_capture);
+  RUN_TEST(test_parse_raw_accepts_unsigned_text);
+  RUN_TEST(test_parse_raw_rejects_bad_input);
+  RUN_TEST(test_parse_raw_clamps_oversized_durations);
+  RUN_TEST(test_parse_hex_bytes);
+  RUN_TEST(test_unpack_binary_durations);
+  RUN_TEST(test_quantize_makes_jittered_frames_identical);
+  RUN_TEST(test_estimate_tick_rejects_noise);
+  RUN_TEST(test_benchmark_parse_ns_per_edge);
+  RUN_TEST(test_benchmark_unpack_bytes_per_s);
+  return UNITY_END();
+}